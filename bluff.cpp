@@ -22,6 +22,7 @@
 
 #include "bluff.h"
 #include "infosetstore.h"
+#include "tasks.h"
 #include "sys/time.h"
 
 #define LOC(b,r,c)  b[r*3 + c]
@@ -38,6 +39,8 @@ double nextCheckpoint = cpWidth;
 unsigned long long nodesTouched = 0;
 unsigned long long ntNextReport = 1000000;  // nodes touched base timing
 unsigned long long ntMultiplier = 2;  // nodes touched base timing
+bool seeded = false;
+unsigned long long randSeed = 0;
 
 // key is roll, value is # of time it shows up. Used only when determining chance outcomes
 map<int,int> outcomes;
@@ -134,13 +137,29 @@ unsigned long long getInfosetKey(GameState & gs, int player, unsigned long long
   return infosetkey;
 }
 
-void getInfoset(GameState & gs, int player, unsigned long long bidseq, Infoset & is, unsigned long long & infosetkey, int actionshere)
+void getInfoset(GameState & gs, int player, unsigned long long bidseq, InfosetView & is, unsigned long long & infosetkey, int actionshere, 
+                bool match)
 {
   infosetkey = getInfosetKey(gs, player, bidseq);
-  bool ret = iss.get(infosetkey, is, actionshere, 0);
+  bool ret = iss.getView(infosetkey, is, actionshere, match);
   assert(ret);
 }
 
+void prefetchChild(GameState gs, int player, unsigned long long bidseq, int bid, bool data)
+{
+  // calling bluff ends the game
+  if (bid >= BLUFFBID)
+    return;
+
+  gs.curbid = bid;
+  unsigned long long key = getInfosetKey(gs, 3-player, bidseq | (1ULL << (BLUFFBID-bid)));
+
+  if (data)
+    iss.prefetch(key, BLUFFBID - bid);
+  else
+    iss.prefetchIndex(key);
+}
+
 int ceiling_log2(int val)
 {
   int exp = 1, num = 2;
@@ -260,10 +279,65 @@ void init()
 
   initBids();
 
+  // e.g. ISS_ALLOC=thp,interleave (see InfosetStore::setAllocation)
+  const char * alloc = getenv("ISS_ALLOC"); 
+  if (alloc != NULL) 
+  {
+    vector<string> parts; 
+    split(parts, alloc, ','); 
+
+    unsigned int allocation = 0; 
+    for (unsigned int i = 0; i < parts.size(); i++) 
+    {
+      if (parts[i] == "thp") allocation |= ISS_ALLOC_THP; 
+      else if (parts[i] == "hugetlb") allocation |= ISS_ALLOC_HUGETLB; 
+      else if (parts[i] == "interleave") allocation |= ISS_ALLOC_INTERLEAVE; 
+      else cerr << "Unknown ISS_ALLOC option: " << parts[i] << endl; 
+    }
+
+    iss.setAllocation(allocation); 
+  }
+
+  // how deep the traversals split into tasks, when running on several threads (see tasks.h)
+  const char * cutoff = getenv("TASK_CUTOFF"); 
+  if (cutoff != NULL) 
+    taskCutoff = MAX(0, to_int(cutoff)); 
+
   cout << "Globals are: " << numChanceOutcomes1 << " " << numChanceOutcomes2 << " " << iscWidth << endl;
 }
 
 
+// Takes the options out of the command line, leaving the other arguments where the solvers
+// expect them. --seed <n>: random numbers from n instead of the clock, so that runs can be
+// repeated (parallel ones too, see cfres and cfros).
+void parseOptions(int & argc, char ** argv)
+{
+  int args = 1;
+
+  for (int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+
+    if (arg == "--seed" && i+1 < argc)
+    {
+      seeded = true;
+      randSeed = to_ull(argv[++i]);
+      seedRand(randSeed);
+      cout << "Random seed: " << randSeed << endl;
+    }
+    else if (arg == "--lock-updates")
+    {
+      iss.setLocking(true);
+      cout << "Locking infoset updates" << endl;
+    }
+    else
+      argv[args++] = argv[i];
+  }
+
+  argc = args;
+  argv[argc] = NULL;
+}
+
 void newInfoset(Infoset & is, int actions)
 {
   is.actionshere = actions;
@@ -454,17 +528,33 @@ void dumpMetaData(string prefix, double totaltime)
   string filename = filepref + prefix + "." + to_string(iter) + ".dat";
   cout << "Dumping metadeta to " + filename + " ... " << endl;
 
+  MetaData md; 
+  getMetaData(md, totaltime); 
+  writeMetaData(filename, md); 
+}
+
+void getMetaData(MetaData & md, double totaltime)
+{
+  md.iter = iter; 
+  md.nodesTouched = nodesTouched; 
+  md.ntNextReport = ntNextReport; 
+  md.ntMultiplier = ntMultiplier; 
+  md.totaltime = totaltime; 
+}
+
+void writeMetaData(string filename, const MetaData & md)
+{
   ofstream outf(filename.c_str(), ios::binary);
   if (!outf.is_open()) {
     cerr << "Could not open meta data file for writing." << endl;
     return;
   }
 
-  outf.write(reinterpret_cast<const char *>(&iter), sizeof(iter));
-  outf.write(reinterpret_cast<const char *>(&nodesTouched), sizeof(nodesTouched));
-  outf.write(reinterpret_cast<const char *>(&ntNextReport), sizeof(ntNextReport));
-  outf.write(reinterpret_cast<const char *>(&ntMultiplier), sizeof(ntMultiplier));
-  outf.write(reinterpret_cast<const char *>(&totaltime), sizeof(totaltime));
+  outf.write(reinterpret_cast<const char *>(&md.iter), sizeof(md.iter));
+  outf.write(reinterpret_cast<const char *>(&md.nodesTouched), sizeof(md.nodesTouched));
+  outf.write(reinterpret_cast<const char *>(&md.ntNextReport), sizeof(md.ntNextReport));
+  outf.write(reinterpret_cast<const char *>(&md.ntMultiplier), sizeof(md.ntMultiplier));
+  outf.write(reinterpret_cast<const char *>(&md.totaltime), sizeof(md.totaltime));
 
   outf.close();
 }
@@ -488,38 +578,14 @@ void loadMetaData(std::string filename)
   inf.close();
 }
 
-// Does a recursive tree walk setting up the information sets, creating the initial strategies
+// Does a recursive walk of the public tree (the bid sequences) setting up the information sets, 
+// creating the initial strategies. The infosets of the player to move, one per chance outcome, 
+// are added one after the other so that they sit together in the store (see InfosetStore::getAll)
 void initInfosets(GameState & gs, int player, int depth, unsigned long long bidseq)
 {
   if (terminal(gs))
     return;
 
-  // check for chance nodes
-  if (gs.p1roll == 0)
-  {
-    for (int i = 1; i <= numChanceOutcomes1; i++)
-    {
-      GameState ngs = gs;
-      ngs.p1roll = i;
-
-      initInfosets(ngs, player, depth+1, bidseq);
-    }
-
-    return;
-  }
-  else if (gs.p2roll == 0)
-  {
-    for (int i = 1; i <= numChanceOutcomes2; i++)
-    {
-      GameState ngs = gs;
-      ngs.p2roll = i;
-
-      initInfosets(ngs, player, depth+1, bidseq);
-    }
-
-    return;
-  }
-
   int maxBid = (gs.curbid == 0 ? BLUFFBID-1 : BLUFFBID);
   int actionshere = maxBid - gs.curbid;
 
@@ -527,9 +593,16 @@ void initInfosets(GameState & gs, int player, int depth, unsigned long long bids
   Infoset is;
   newInfoset(is, actionshere);
 
+  for (int i = 1; i <= numChanceOutcomes(player); i++)
+  {
+    GameState ngs = gs;
+    (player == 1 ? ngs.p1roll : ngs.p2roll) = i;
+    iss.put(getInfosetKey(ngs, player, bidseq), is, actionshere, 0);
+  }
+
   for (int i = gs.curbid+1; i <= maxBid; i++)
   {
-    if (depth == 2 && i == (gs.curbid+1)) {
+    if (depth == 1 && i == (gs.curbid+1)) {
       cout << "InitTrees. iss stats = " << iss.getStats() << endl;
     }
 
@@ -542,23 +615,6 @@ void initInfosets(GameState & gs, int player, int depth, unsigned long long bids
 
     initInfosets(ngs, (3-player), depth+1, newbidseq);
   }
-
-  unsigned infosetkey = 0;
-  infosetkey = bidseq;
-  infosetkey <<= iscWidth;
-  if (player == 1)
-  {
-    infosetkey |= gs.p1roll;
-    infosetkey <<= 1;
-    iss.put(infosetkey, is, actionshere, 0);
-  }
-  else if (player == 2)
-  {
-    infosetkey |= gs.p2roll;
-    infosetkey <<= 1;
-    infosetkey |= 1;
-    iss.put(infosetkey, is, actionshere, 0);
-  }
 }
 
 void initInfosets()
@@ -570,12 +626,12 @@ void initInfosets()
   cout << "Initialize info set store..." << endl;
   // # doubles in total, size of index (must be at least # infosets)
   // 2 doubles per iapair + 2 per infoset =
+  // These are only starting sizes; the store grows as the infosets are added, so other
+  // games start small rather than needing the counts from bluffcounter
   if (P1DICE == 1 && P2DICE == 1 && DIEFACES == 6)
     iss.init(147432, 100000);
   else
-  {
-    cerr << "initInfosets not defined for this PXDICE + DIEFACES" << endl;
-  }
+    iss.init(0, 0);
 
   assert(iss.getSize() > 0);
 
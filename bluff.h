@@ -5,6 +5,7 @@
 #include <sys/timeb.h>
 
 #include <cmath>
+#include <cstring>
 #include <string>
 #include <limits>
 #include <map>
@@ -40,6 +41,16 @@ struct GameState
   }
 };
 
+// What is saved in the metainfo files that go with the strategies files
+struct MetaData
+{
+  unsigned long long iter;
+  unsigned long long nodesTouched;
+  unsigned long long ntNextReport;
+  unsigned long long ntMultiplier;
+  double totaltime;
+};
+
 struct Infoset
 {
   double cfr[BLUFFBID];
@@ -50,6 +61,33 @@ struct Infoset
   unsigned long long lastUpdate;
 };
 
+// A handle to an infoset's block inside the InfosetStore (see InfosetStore::getView).
+// Nothing is copied: regrets and average strategy are read and updated in place,
+// so there is no need to put the infoset back. Only curMoveProbs is local; it is
+// filled in by regret matching when the view is obtained.
+struct InfosetView
+{
+  double * block;   // first cell of the infoset in the store (the # of actions)
+  double * cached;  // its entry in the store's strategy cache (NULL if none)
+  double curMoveProbs[BLUFFBID];
+
+  int actionshere;
+
+  // after the # of actions and the last update, the block holds all the regrets
+  // followed by all the average strategy sums (two contiguous arrays, see simd.h)
+  RegretValue * cfrArray() { return reinterpret_cast<RegretValue *>(block + BLOCK_HEADER_CELLS); }
+  AvgValue * totalMoveProbsArray() { return reinterpret_cast<AvgValue *>(cfrArray() + actionshere); }
+
+  RegretValue & cfr(int a) { return cfrArray()[a]; }
+  AvgValue & totalMoveProbs(int a) { return totalMoveProbsArray()[a]; }
+
+  unsigned long long getLastUpdate() const { return blockLastUpdate(block); }
+  void setLastUpdate(unsigned long long x) { setBlockLastUpdate(block, x); }
+
+  // the cached strategy (see InfosetStore::cacheStrategies) no longer matches the regrets
+  void regretsUpdated() { if (cached != NULL) cached[0] = 0.0; }
+};
+
 // game-specific function defs (implemented in bluff.cpp)
 bool terminal(GameState & gs);
 double payoff(GameState & gs, int player);
@@ -58,6 +96,7 @@ int whowon(GameState & gs);
 int whowon(GameState & gs, int & delta);
 int whowon(int bid, int bidder, int callingPlayer, int p1roll, int p2roll, int & delta);
 void init();
+void parseOptions(int & argc, char ** argv);
 double getChanceProb(int player, int outcome);
 void convertbid(int & dice, int & face, int bid);
 int countMatchingDice(const GameState & gs, int player, int face);
@@ -80,11 +119,28 @@ bool replace(std::string& str, const std::string& from, const std::string& to);
 std::string getCurDateTime();
 void seedCurMicroSec();
 double unifRand01();
+void seedRand(unsigned long long seed);
+void seedThreadRand(unsigned long long seed);  // from now on, this thread draws from its own stream
+// which stream this thread draws from, so that it can be put back after seedThreadRand
+struct ThreadRandState
+{
+  bool own;
+  unsigned short state[3];
+};
+void saveThreadRand(ThreadRandState & saved);
+void restoreThreadRand(const ThreadRandState & saved);
+// until endRandStream, this thread draws from the counter-based stream of (iteration, player, thread)
+void setRandStream(unsigned long long seed, unsigned long long iteration, int player, int thread);
+void endRandStream();
 
 // solver-specific function defs
 void newInfoset(Infoset & is, int actionshere);
 unsigned long long getInfosetKey(GameState & gs, int player, unsigned long long bidseq);
-void getInfoset(GameState & gs, int player, unsigned long long bidseq, Infoset & is, unsigned long long & infosetkey, int actionshere);
+void getInfoset(GameState & gs, int player, unsigned long long bidseq, InfosetView & is, unsigned long long & infosetkey, int actionshere, 
+                bool match = true);
+// prefetches the infoset of the opponent after player bids bid at gs (with data = false, only
+// its index slot), see InfosetStore::prefetch
+void prefetchChild(GameState gs, int player, unsigned long long bidseq, int bid, bool data);
 void initInfosets();
 void initSeqStore();
 void allocSeqStore();
@@ -94,6 +150,8 @@ void report(std::string filename, double totaltime, double bound, double conv);
 void dumpInfosets(std::string prefix);
 void dumpSeqStore(std::string prefix);
 void dumpMetaData(std::string prefix, double totaltime);
+void getMetaData(MetaData & md, double totaltime);
+void writeMetaData(std::string filename, const MetaData & md);
 void loadMetaData(std::string file);
 double getBoundMultiplier(std::string algorithm);
 double evaluate();
@@ -111,7 +169,54 @@ double absComputeBestResponses(bool abs, bool avgFix);
 void sampleMoveAvg(Infoset & is, int actionshere, int & index, double & prob);
 void sampleChanceEvent(int player, int & outcome, double & prob);
 void sampleMoveAvg(Infoset & is, int actionshere, int & index, double & prob);
-int sampleAction(Infoset & is, int actionshere, double & sampleprob, double epsilon, bool firstTimeUniform);
+int sampleAction(InfosetView & is, int actionshere, double & sampleprob, double epsilon, bool firstTimeUniform);
+int sampleRegretAction(InfosetView & is, int actionshere);
+void runSamplingThreads(unsigned long long (*iteration)(int thread), unsigned long long iters, 
+                        unsigned long long target);
+
+// An infoset's updates, kept aside in an UpdateBuffer
+struct BufferedInfoset
+{
+  unsigned long long key;
+  unsigned int slot;
+  int player;
+  int actionshere;
+  InfosetView is;                // its block in the store, and its strategy when first reached
+  bool regretsChanged;
+  bool averageChanged;
+  double regretDelta[BLUFFBID];  // sum of the regret updates
+  double avgWeight;              // sum of the weights of is.curMoveProbs in the av. strategy
+};
+
+// Updates to infosets, kept aside and then added to the store all at once: so that many 
+// samples are taken from the same strategies, or so that the updates of several threads are
+// added in a set order. Each infoset is got from the store only once.
+class UpdateBuffer
+{
+  std::vector<BufferedInfoset> infosets;  // in the order they were first reached
+  std::vector<int> slots;                 // hash table of the infosets by key (-1 = empty)
+  unsigned int slotMask;
+
+  void grow();
+
+public:
+  UpdateBuffer(unsigned int expectedInfosets);
+
+  // the infoset's index, getting it from the store the first time (see getInfoset)
+  int find(GameState & gs, int player, unsigned long long bidseq, int actionshere);
+
+  BufferedInfoset & operator[](int i) { return infosets[i]; }
+  double * regretDelta(int i) { infosets[i].regretsChanged = true; return infosets[i].regretDelta; }
+  void addAverage(int i, double weight) { infosets[i].averageChanged = true; infosets[i].avgWeight += weight; }
+
+  // adds the updates to the store, in the order the infosets were first reached, and empties
+  void apply();
+};
+
+// checkpoints (impl in checkpoint.cpp)
+void checkpoint(std::string runname, double totaltime);
+void finishCheckpoints();
+bool loadCheckpoint(std::string filename);
 
 // global variables
 class InfosetStore;
@@ -124,6 +229,11 @@ extern double nextCheckpoint;            // used for timing/stats
 extern unsigned long long ntNextReport;  // used for timing/stats
 extern unsigned long long ntMultiplier;  // used for timing/stats
 extern unsigned long long nodesTouched;  // used for timing/stats
+extern unsigned int checkpointsToKeep;   // # of the latest checkpoints kept on disk (0 = all)
+extern unsigned int fullCheckpointEvery; // checkpoints in between are deltas
+extern bool compressCheckpoints;         // write complete checkpoints compressed
+extern bool seeded;                      // --seed was given (see parseOptions)
+extern unsigned long long randSeed;      // the seed given
 
 class StopWatch
 {
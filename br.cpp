@@ -7,6 +7,8 @@
 #include "normalizer.h"
 #include "fvector.h"
 #include "bluff.h"
+#include "simd.h"
+#include "tasks.h"
 
 // The code in here is quite complicated. See Appendix B of my thesis. 
 // This code implements algorithm 8, "Best Response Algorithm for Bluff and Poker Games", 
@@ -30,7 +32,8 @@ void getInfoset(unsigned long long & infosetkey, Infoset & is, unsigned long lon
 
   bool ret = false; 
 
-  ret = iss.get(infosetkey, is, actionshere, 0); 
+  // only the average strategy is needed (fixAvStrat does the regret matching if it has to)
+  ret = iss.get(infosetkey, is, actionshere, 0, false); 
 
   if (!ret) cerr << "infoset get failed, infosetkey = " << infosetkey << endl;
   assert(ret);  
@@ -50,12 +53,28 @@ double getMoveProb(Infoset & is, int action, int actionshere)
     return (1.0 / actionshere);
 }
 
+double getMoveProb(InfosetView & is, int action, int actionshere)
+{ 
+  double den = 0.0; 
+  
+  for (int a = 0; a < actionshere; a++)
+    if (is.totalMoveProbs(a) > 0.0)
+      den += is.totalMoveProbs(a);
+
+  if (den > 0.0) 
+    return (is.totalMoveProbs(action) / den); 
+  else
+    return (1.0 / actionshere);
+}
+
 // This implements the average strategy patch needed by optimisitc averaging, from section 4.4 of my thesis.
 // This function should never be called by this code base because optimistic averaging is not included here.
 void fixAvStrat(unsigned long long infosetkey, Infoset & is, int actionshere, double myreach)
 {
   if (iter > is.lastUpdate)
   {
+    regretMatching(is.cfr, is.curMoveProbs, actionshere); 
+
     for (int a = 0; a < actionshere; a++) 
     {
       double inc =   (iter - is.lastUpdate)
@@ -72,10 +91,10 @@ void fixAvStrat(unsigned long long infosetkey, Infoset & is, int actionshere, do
 
 // Compute the weight for this action over all chance outcomes
 // Used for determining probability of action
-// Done only at fixed_player nodes
+// Done only at fixed_player nodes, whose infosets are in oppInfosets (one per chance outcome)
 void computeActionDist(unsigned long long bidseq, int player, int fixed_player, 
                        NormalizerMap & oppActionDist, int action, FVector<double> & newOppReach, 
-                       int actionshere)
+                       int actionshere, InfosetView * oppInfosets)
 {
   double weight = 0.0; 
 
@@ -86,17 +105,21 @@ void computeActionDist(unsigned long long bidseq, int player, int fixed_player,
     assert(oppChanceOutcomes.size() == CO);
 
     int chanceOutcome = oppChanceOutcomes[i]; 
+    double oppProb = 0.0; 
   
-    // get the information set that corresponds to it
-    Infoset is;
-    unsigned long long infosetkey = 0; 
-    getInfoset(infosetkey, is, bidseq, player, actionshere, chanceOutcome); 
-
-    // apply out-of-date mccfr patch if needed. note: we know it's always the fixed player here
-    if (mccfrAvgFix)
+    if (mccfrAvgFix) 
+    {
+      // get the information set that corresponds to it, and apply the out-of-date mccfr 
+      // patch if needed. note: we know it's always the fixed player here
+      Infoset is;
+      unsigned long long infosetkey = 0; 
+      getInfoset(infosetkey, is, bidseq, player, actionshere, chanceOutcome); 
       fixAvStrat(infosetkey, is, actionshere, newOppReach[i]); 
-   
-    double oppProb = getMoveProb(is, action, actionshere); 
+      oppProb = getMoveProb(is, action, actionshere); 
+    }
+    else 
+      oppProb = getMoveProb(oppInfosets[chanceOutcome-1], action, actionshere); 
+
     CHKPROB(oppProb); 
     newOppReach[i] = newOppReach[i] * oppProb; 
 
@@ -117,6 +140,20 @@ double getPayoff(GameState gs, int fixed_player, int oppChanceOutcome)
   return payoff(gs, updatePlayer); 
 }
 
+double expectimaxbr(GameState gs, unsigned long long bidseq, int player, int fixed_player, int depth, FVector<double> & oppReach);
+
+// a child's subtree, traversed as a task (see tasks.h)
+struct BRChild
+{
+  GameState gs;
+  unsigned long long bidseq;
+  int player, fixed_player, depth;
+  FVector<double> oppReach;
+  double value;
+
+  void run() { value = expectimaxbr(gs, bidseq, player, fixed_player, depth, oppReach); }
+};
+
 double expectimaxbr(GameState gs, unsigned long long bidseq, int player, int fixed_player, int depth, FVector<double> & oppReach)
 {
   assert(fixed_player == 1 || fixed_player == 2); 
@@ -223,6 +260,21 @@ double expectimaxbr(GameState gs, unsigned long long bidseq, int player, int fix
   int action = -1;
   NormalizerMap oppActionDist;
 
+  // the fixed player's infosets here, one per chance outcome (read for every action)
+  InfosetView oppInfosets[player == fixed_player ? oppChanceOutcomes.size() : 1];
+  if (player == fixed_player && !mccfrAvgFix) 
+  {
+    int found = iss.getAll(bidseq, player, oppInfosets, actionshere, false); 
+    if (found == 0) cerr << "infoset getAll failed, bidseq = " << bidseq << endl;
+    assert(found == static_cast<int>(oppChanceOutcomes.size()));
+  }
+
+  // near the root, the children are traversed as tasks (nothing is written, unless the 
+  // average strategies are being fixed)
+  bool spawn = spawnTasks(depth) && !mccfrAvgFix; 
+  BRChild children[spawn ? actionshere : 1]; 
+  TaskGroup group; 
+
   for (int i = gs.curbid+1; i <= maxBid; i++) 
   {
     action++;    
@@ -231,7 +283,7 @@ double expectimaxbr(GameState gs, unsigned long long bidseq, int player, int fix
     FVector<double> newOppReach = oppReach;
       
     if (player == fixed_player) 
-      computeActionDist(bidseq, player, fixed_player, oppActionDist, action, newOppReach, actionshere); 
+      computeActionDist(bidseq, player, fixed_player, oppActionDist, action, newOppReach, actionshere, oppInfosets); 
 
     // state transition + recursion
     GameState ngs = gs; 
@@ -241,6 +293,19 @@ double expectimaxbr(GameState gs, unsigned long long bidseq, int player, int fix
     unsigned long long newbidseq = bidseq; 
     newbidseq |= (1ULL << (BLUFFBID-i)); 
 
+    if (spawn) 
+    {
+      BRChild & child = children[action]; 
+      child.gs = ngs; 
+      child.bidseq = newbidseq; 
+      child.player = 3-player; 
+      child.fixed_player = fixed_player; 
+      child.depth = depth+1; 
+      child.oppReach = newOppReach; 
+      group.spawn(child); 
+      continue; 
+    }
+
     childEV = expectimaxbr(ngs, newbidseq, 3-player, fixed_player, depth+1, newOppReach);
     
     // post recurse
@@ -259,6 +324,20 @@ double expectimaxbr(GameState gs, unsigned long long bidseq, int player, int fix
     }
   }
 
+  if (spawn) 
+  {
+    group.wait(); 
+
+    // in the serial order
+    for (int a = 0; a < actionshere; a++) 
+    {
+      if (player == updatePlayer && children[a].value >= maxEV) 
+        maxEV = children[a].value; 
+      else if (player == fixed_player) 
+        childEVs[a] = children[a].value; 
+    }
+  }
+
   // post move iteration
   if (player == updatePlayer)
   {
@@ -2,14 +2,38 @@
 #include <cassert>
 #include <iostream>
 #include <cstdlib>
+#include <vector>
 
 #include "bluff.h"
+#include "simd.h"
+#include "tasks.h"
 
 using namespace std; 
 
+// the strategy cache takes as much memory again as the table: only used below this many cells
+#define STRATEGY_CACHE_MAX_CELLS (1ULL << 27)
+
 static unsigned long long nextReport = 1;
 static unsigned long long reportMult = 2;
 
+// nodes touched during the current traversal (added to nodesTouched after it)
+static TaskCounter traversalNodes;
+
+double cfr(GameState & gs, int player, int depth, unsigned long long bidseq, 
+           double reach1, double reach2, double chanceReach, int phase, int updatePlayer);
+
+// a child's subtree, traversed as a task (see tasks.h)
+struct CfrChild
+{
+  GameState gs;
+  unsigned long long bidseq;
+  double reach1, reach2, chanceReach;
+  int player, depth, phase, updatePlayer;
+  double value;
+
+  void run() { value = cfr(gs, player, depth, bidseq, reach1, reach2, chanceReach, phase, updatePlayer); }
+};
+
 // This is Vanilla CFR. See my thesis, Algorithm 1 (Section 2.2.2)
 double cfr(GameState & gs, int player, int depth, unsigned long long bidseq, 
            double reach1, double reach2, double chanceReach, int phase, int updatePlayer)
@@ -20,7 +44,7 @@ double cfr(GameState & gs, int player, int depth, unsigned long long bidseq,
     return payoff(gs, updatePlayer);
   }
 
-  nodesTouched++;
+  traversalNodes.inc();
 
   // Chances nodes at the top of the tree. If p1roll and p2roll not set, we're at a chance node
   if (gs.p1roll == 0) 
@@ -68,7 +92,7 @@ double cfr(GameState & gs, int player, int depth, unsigned long long bidseq,
   }
 
   // declare the variables 
-  Infoset is;
+  InfosetView is;
   unsigned long long infosetkey = 0;
   double stratEV = 0.0;
   int action = -1;
@@ -81,12 +105,33 @@ double cfr(GameState & gs, int player, int depth, unsigned long long bidseq,
   for (int i = 0; i < actionshere; i++) 
     moveEVs[i] = 0.0;
 
-  // get the info set (also set is.curMoveProbs using regret matching)
+  // get the info set (also set is.curMoveProbs using regret matching, or the cached strategy)
   getInfoset(gs, player, bidseq, is, infosetkey, actionshere); 
 
+  // near the root, the children are traversed as tasks (only this infoset is updated here,
+  // and only after all of them are done)
+  bool spawn = spawnTasks(depth); 
+  CfrChild children[spawn ? actionshere : 1]; 
+  TaskGroup group; 
+
+  // on large stores, the children's infosets are fetched ahead: the index slot two children
+  // ahead, the data of the next one (while the previous one is being traversed)
+  bool ahead = iss.isPrefetching(); 
+  if (ahead) 
+  {
+    prefetchChild(gs, player, bidseq, gs.curbid+1, true); 
+    prefetchChild(gs, player, bidseq, gs.curbid+2, false); 
+  }
+
   // iterate over the actions
   for (int i = gs.curbid+1; i <= maxBid; i++) 
   {
+    if (ahead) 
+    {
+      prefetchChild(gs, player, bidseq, i+1, true); 
+      prefetchChild(gs, player, bidseq, i+2, false); 
+    }
+
     action++;
     assert(action < actionshere);
 
@@ -100,6 +145,22 @@ double cfr(GameState & gs, int player, int depth, unsigned long long bidseq,
     ngs.curbid = i; 
     ngs.callingPlayer = player;
     newbidseq |= (1ULL << (BLUFFBID-i)); 
+
+    if (spawn) 
+    {
+      CfrChild & child = children[action]; 
+      child.gs = ngs; 
+      child.bidseq = newbidseq; 
+      child.reach1 = newreach1; 
+      child.reach2 = newreach2; 
+      child.chanceReach = chanceReach; 
+      child.player = 3-player; 
+      child.depth = depth+1; 
+      child.phase = phase; 
+      child.updatePlayer = updatePlayer; 
+      group.spawn(child); 
+      continue; 
+    }
     
     double payoff = cfr(ngs, 3-player, depth+1, newbidseq, newreach1, newreach2, chanceReach, phase, updatePlayer); 
    
@@ -107,21 +168,34 @@ double cfr(GameState & gs, int player, int depth, unsigned long long bidseq,
     stratEV += moveProb*payoff; 
   }
 
+  if (spawn) 
+  {
+    group.wait(); 
+
+    // in the serial order
+    for (int a = 0; a < actionshere; a++) 
+    {
+      moveEVs[a] = children[a].value; 
+      stratEV += is.curMoveProbs[a]*moveEVs[a]; 
+    }
+  }
+
 
   // post-traversals: update the infoset
   double myreach = (player == 1 ? reach1 : reach2); 
   double oppreach = (player == 1 ? reach2 : reach1); 
 
+  // other threads may be updating the same infoset (see InfosetStore::setLocking)
+  iss.lock(is); 
+
   // update regret
   if (phase == 1 && player == updatePlayer)
   {
-    for (int a = 0; a < actionshere; a++)
-    {
-      // Multiplying by chanceReach here is important in games that have non-uniform chance outcome 
-      // distributions. In Bluff(1,1) it is actually not needed, but in general it is needed (e.g. 
-      // in Bluff(2,1)). 
-      is.cfr[a] += (chanceReach*oppreach)*(moveEVs[a] - stratEV); 
-    }
+    // Multiplying by chanceReach here is important in games that have non-uniform chance outcome 
+    // distributions. In Bluff(1,1) it is actually not needed, but in general it is needed (e.g. 
+    // in Bluff(2,1)). 
+    addScaledDiff(is.cfrArray(), moveEVs, stratEV, chanceReach*oppreach, actionshere); 
+    is.regretsUpdated(); 
   }
 
   // update average strat
@@ -130,25 +204,92 @@ double cfr(GameState & gs, int player, int depth, unsigned long long bidseq,
   // this part does not exist in decision holdem or other cfr algos
   if (phase >= 1 && player == updatePlayer)
   {
-    for (int a = 0; a < actionshere; a++)
+    addScaled(is.totalMoveProbsArray(), is.curMoveProbs, myreach, actionshere); 
+  }
+
+  iss.unlock(is); 
+
+  return stratEV;
+}
+
+// The subtrees under one of updatePlayer's chance outcomes
+struct RollSubtrees
+{
+  int updatePlayer; 
+  int roll; 
+  double * values;                // of the subtree under each (p1roll, p2roll)
+
+  void run() 
+  {
+    // the opponent's outcomes in the order the serial traversal goes through them
+    for (int o = 1; o <= numChanceOutcomes(3 - updatePlayer); o++) 
     {
-      is.totalMoveProbs[a] += myreach*is.curMoveProbs[a]; 
+      GameState gs; 
+      gs.p1roll = (updatePlayer == 1 ? roll : o); 
+      gs.p2roll = (updatePlayer == 1 ? o : roll); 
+      double chanceReach = getChanceProb(2, gs.p2roll)*(getChanceProb(1, gs.p1roll)*1.0); 
+
+      values[(gs.p1roll-1)*numChanceOutcomes(2) + (gs.p2roll-1)] 
+        = cfr(gs, 1, 2, 0, 1.0, 1.0, chanceReach, 1, updatePlayer); 
     }
   }
+};
+
+// One traversal of the tree, updating updatePlayer's regrets and average strategy. 
+//
+// With several task threads, each of updatePlayer's chance outcomes is a task. Only 
+// updatePlayer's infosets are updated, and each one lies under a single one of its outcomes:
+// each task goes through the opponent's outcomes in the usual order, so every infoset sees
+// the same updates in the same order as in a serial traversal (the opponent's are only read).
+// Below that, the children of the nodes above the cutoff are tasks too (see cfr). Adding up 
+// the values in the serial order then gives the same results bit for bit. Handing out the 
+// opponent's outcomes as well would change what the serial algorithm computes, since it 
+// updates the regrets as it goes.
+static double traverse(int updatePlayer)
+{
+  if (taskThreads <= 1)
+  {
+    GameState gs; 
+    double EV = cfr(gs, 1, 0, 0, 1.0, 1.0, 1.0, 1, updatePlayer);
+    nodesTouched += traversalNodes.take(); 
+    return EV; 
+  }
 
+  int co = numChanceOutcomes(updatePlayer); 
+  vector<double> values(numChanceOutcomes(1)*numChanceOutcomes(2)); 
+  vector<RollSubtrees> rolls(co); 
+  TaskGroup group; 
 
-  // save the infoset back to the store if needed
-  if (player == updatePlayer) {
-    iss.put(infosetkey, is, actionshere, 0); 
+  for (int r = 1; r <= co; r++) 
+  {
+    rolls[r-1].updatePlayer = updatePlayer; 
+    rolls[r-1].roll = r; 
+    rolls[r-1].values = &values[0]; 
+    group.spawn(rolls[r-1]); 
   }
+  group.wait(); 
 
-  return stratEV;
+  // the root and p1's chance nodes, which the subtrees were started below
+  nodesTouched += traversalNodes.take() + 1 + numChanceOutcomes(1); 
+
+  double EV = 0.0; 
+  for (int i = 1; i <= numChanceOutcomes(1); i++) 
+  {
+    double EV2 = 0.0; 
+    for (int j = 1; j <= numChanceOutcomes(2); j++) 
+      EV2 += getChanceProb(2,j)*values[(i-1)*numChanceOutcomes(2) + (j-1)]; 
+
+    EV += getChanceProb(1,i)*EV2; 
+  }
+
+  return EV; 
 }
 
 int main(int argc, char ** argv)
 {
   unsigned long long maxIters = 0; 
   init();
+  parseOptions(argc, argv);
 
   if (argc < 2)
   {
@@ -159,10 +300,19 @@ int main(int argc, char ** argv)
   { 
     string filename = argv[1];
     cout << "Reading the infosets from " << filename << "..." << endl;
-    iss.readFromDisk(filename);
+    iss.mapFromDisk(filename);
+
+    // each infoset is visited once per opponent chance outcome, mostly with the same regrets
+    if (iss.getSize() <= STRATEGY_CACHE_MAX_CELLS)
+      iss.cacheStrategies();
+    else
+      cout << "Table too big to cache the strategies, regret matching at every visit" << endl;
 
     if (argc >= 3)
       maxIters = to_ull(argv[2]);
+
+    if (argc >= 4)
+      initTasks(to_int(argv[3]));
   }  
   
   // get the iteration
@@ -176,22 +326,18 @@ int main(int argc, char ** argv)
   cout << "Set iteration to " << iter << endl;
   iter = MAX(1,iter);
 
-  unsigned long long bidseq = 0; 
-    
   StopWatch stopwatch;
   double totaltime = 0; 
 
-  cout << "Starting CFR iterations" << endl;
+  cout << "Starting CFR iterations";
+  if (taskThreads > 1)
+    cout << " (" << taskThreads << " threads)";
+  cout << endl;
 
   for (; true; iter++)
   {
-    GameState gs1; 
-    bidseq = 0; 
-    double ev1 = cfr(gs1, 1, 0, bidseq, 1.0, 1.0, 1.0, 1, 1);
-    
-    GameState gs2; 
-    bidseq = 0; 
-    double ev2 = cfr(gs2, 1, 0, bidseq, 1.0, 1.0, 1.0, 1, 2);
+    double ev1 = traverse(1);
+    double ev2 = traverse(2);
 
     if (iter % 10 == 0)
     { 
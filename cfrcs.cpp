@@ -4,6 +4,8 @@
 #include <cstdlib>
 
 #include "bluff.h"
+#include "simd.h"
+#include "tasks.h"
 
 // chance sampling
 
@@ -11,6 +13,24 @@ using namespace std;
 
 static string runname = "";
 
+// nodes touched during the current traversal (added to nodesTouched after it)
+static TaskCounter traversalNodes;
+
+double cfrcs(GameState & gs, int player, int depth, unsigned long long bidseq, 
+             double reach1, double reach2, int phase, int updatePlayer);
+
+// a child's subtree, traversed as a task (see tasks.h)
+struct CfrcsChild
+{
+  GameState gs;
+  unsigned long long bidseq;
+  double reach1, reach2;
+  int player, depth, phase, updatePlayer;
+  double value;
+
+  void run() { value = cfrcs(gs, player, depth, bidseq, reach1, reach2, phase, updatePlayer); }
+};
+
 double cfrcs(GameState & gs, int player, int depth, unsigned long long bidseq, 
              double reach1, double reach2, int phase, int updatePlayer)
 {
@@ -20,7 +40,7 @@ double cfrcs(GameState & gs, int player, int depth, unsigned long long bidseq,
     return payoff(gs, updatePlayer);
   }
 
-  nodesTouched++;
+  traversalNodes.inc();
 
   // chance nodes
   if (gs.p1roll == 0) 
@@ -74,7 +94,7 @@ double cfrcs(GameState & gs, int player, int depth, unsigned long long bidseq,
   }
 
   // declare the variables
-  Infoset is;
+  InfosetView is;
   unsigned long long infosetkey = 0;
   double stratEV = 0.0;
   int action = -1;
@@ -89,9 +109,30 @@ double cfrcs(GameState & gs, int player, int depth, unsigned long long bidseq,
   // get the info set (also set is.curMoveProbs using regret matching)
   getInfoset(gs, player, bidseq, is, infosetkey, actionshere); 
 
+  // near the root, the children are traversed as tasks (only this infoset is updated here,
+  // and only after all of them are done)
+  bool spawn = spawnTasks(depth); 
+  CfrcsChild children[spawn ? actionshere : 1]; 
+  TaskGroup group; 
+
+  // on large stores, the children's infosets are fetched ahead: the index slot two children
+  // ahead, the data of the next one (while the previous one is being traversed)
+  bool ahead = iss.isPrefetching(); 
+  if (ahead) 
+  {
+    prefetchChild(gs, player, bidseq, gs.curbid+1, true); 
+    prefetchChild(gs, player, bidseq, gs.curbid+2, false); 
+  }
+
   // iterate over the actions
   for (int i = gs.curbid+1; i <= maxBid; i++) 
   {
+    if (ahead) 
+    {
+      prefetchChild(gs, player, bidseq, i+1, true); 
+      prefetchChild(gs, player, bidseq, i+2, false); 
+    }
+
     // there is a valid action here
     action++;
     assert(action < actionshere);
@@ -106,6 +147,21 @@ double cfrcs(GameState & gs, int player, int depth, unsigned long long bidseq,
     ngs.curbid = i; 
     ngs.callingPlayer = player;
     newbidseq |= (1ULL << (BLUFFBID-i)); 
+
+    if (spawn) 
+    {
+      CfrcsChild & child = children[action]; 
+      child.gs = ngs; 
+      child.bidseq = newbidseq; 
+      child.reach1 = newreach1; 
+      child.reach2 = newreach2; 
+      child.player = 3-player; 
+      child.depth = depth+1; 
+      child.phase = phase; 
+      child.updatePlayer = updatePlayer; 
+      group.spawn(child); 
+      continue; 
+    }
     
     double payoff = cfrcs(ngs, 3-player, depth+1, newbidseq, newreach1, newreach2, phase, updatePlayer); 
    
@@ -113,33 +169,41 @@ double cfrcs(GameState & gs, int player, int depth, unsigned long long bidseq,
     stratEV += moveProb*payoff; 
   }
 
+  if (spawn) 
+  {
+    group.wait(); 
+
+    // in the serial order
+    for (int a = 0; a < actionshere; a++) 
+    {
+      moveEVs[a] = children[a].value; 
+      stratEV += is.curMoveProbs[a]*moveEVs[a]; 
+    }
+  }
+
   // post-traversals: update the infoset
   double myreach = (player == 1 ? reach1 : reach2); 
   double oppreach = (player == 1 ? reach2 : reach1); 
 
+  iss.lock(is); 
+
   if (phase == 1 && player == updatePlayer) // regrets
   {
-    for (int a = 0; a < actionshere; a++)
-    {
-      // notice no chanceReach included here, unlike in Vanilla CFR
-      // because it gets cancelled with q(z) in the denominator 
-      is.cfr[a] += oppreach*(moveEVs[a] - stratEV); 
-    }
+    // notice no chanceReach included here, unlike in Vanilla CFR
+    // because it gets cancelled with q(z) in the denominator 
+    addScaledDiff(is.cfrArray(), moveEVs, stratEV, oppreach, actionshere); 
   }
 
   if (phase >= 1 && player == updatePlayer) // av. strat
   {
-    for (int a = 0; a < actionshere; a++)
-    {
-      is.totalMoveProbs[a] += myreach*is.curMoveProbs[a]; 
-    }
-  }
+    addScaled(is.totalMoveProbsArray(), is.curMoveProbs, myreach, actionshere); 
 
-  // save the infoset back to the store if needed
-  if (player == updatePlayer) {
-    iss.put(infosetkey, is, actionshere, 0); 
+    // the infoset changed in this iteration (delta checkpoints only save those)
+    is.setLastUpdate(iter); 
   }
 
+  iss.unlock(is); 
+
   return stratEV;
 }
 
@@ -148,6 +212,7 @@ int main(int argc, char ** argv)
   unsigned long long maxIters = 0; 
   unsigned long long maxNodesTouched = 0; 
   init();
+  parseOptions(argc, argv);
 
   if (argc < 2)
   {
@@ -158,12 +223,19 @@ int main(int argc, char ** argv)
   { 
     string filename = argv[1];
     cout << "Reading the infosets from " << filename << "..." << endl;
-    iss.readFromDisk(filename);
+    if (!loadCheckpoint(filename))
+    {
+      cerr << "Problem reading file. " << endl; 
+      exit(-1); 
+    }
   
     if (argc >= 3) 
       runname = argv[2];
     else   
       runname = "bluff11";
+
+    if (argc >= 4)
+      initTasks(to_int(argv[3]));
   } 
 
   // get the iteration
@@ -202,6 +274,8 @@ int main(int argc, char ** argv)
     bidseq = 0; 
     cfrcs(gs2, 1, 0, bidseq, 1.0, 1.0, 1, 2);
 
+    nodesTouched += traversalNodes.take(); 
+
     if (   (maxNodesTouched > 0 && nodesTouched >= maxNodesTouched)
         || (maxNodesTouched == 0 && nodesTouched > ntNextReport))
     {
@@ -228,8 +302,7 @@ int main(int argc, char ** argv)
       conv = computeBestResponses(false);
       string str = "cfrcs." + runname + ".report.txt"; 
       report(str, totaltime, bound, conv);
-      //dumpInfosets("iss-" + runname); 
-      //dumpMetaData("metainfo-" + runname, totaltime); 
+      checkpoint(runname, totaltime); 
 
       cout << "Report done at: " << getCurDateTime() << endl;
 
@@ -243,5 +316,7 @@ int main(int argc, char ** argv)
 
     if (iter == maxIters) break;
   }
+
+  finishCheckpoints(); 
 }
 
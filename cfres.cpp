@@ -3,8 +3,11 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 
 #include "bluff.h"
+#include "simd.h"
+#include "tasks.h"
 
 // external sampling
 
@@ -12,6 +15,13 @@ using namespace std;
 
 static string runname = "";
 
+// nodes touched by this thread in the current iteration
+static __thread unsigned long long threadNodes = 0;
+
+// in a deterministic round (see deterministicRound), where this thread's updates go
+static __thread UpdateBuffer * threadUpdates = NULL;
+static vector<UpdateBuffer *> roundUpdates;  // one per thread
+
 double cfres(GameState & gs, int player, int depth, unsigned long long bidseq, int updatePlayer)
 {
   // check: at terminal node?
@@ -20,7 +30,7 @@ double cfres(GameState & gs, int player, int depth, unsigned long long bidseq, i
     return payoff(gs, updatePlayer); 
   }
 
-  nodesTouched++;
+  threadNodes++;
 
   // chance nodes
   if (gs.p1roll == 0) 
@@ -51,7 +61,7 @@ double cfres(GameState & gs, int player, int depth, unsigned long long bidseq, i
   }
   
   // declare the variables
-  Infoset is;
+  InfosetView is;
   unsigned long long infosetkey = 0;
   int action = -1;
   
@@ -63,8 +73,17 @@ double cfres(GameState & gs, int player, int depth, unsigned long long bidseq, i
   for (int i = 0; i < actionshere; i++) 
     moveEVs[i] = 0.0;
 
-  // get the info set (also set is.curMoveProbs using regret matching)
-  getInfoset(gs, player, bidseq, is, infosetkey, actionshere); 
+  // get the info set (also set is.curMoveProbs using regret matching), through the thread's
+  // updates in a deterministic round
+  UpdateBuffer * updates = threadUpdates; 
+  int buffered = -1; 
+  if (updates != NULL) 
+  {
+    buffered = updates->find(gs, player, bidseq, actionshere); 
+    is = (*updates)[buffered].is; 
+  }
+  else
+    getInfoset(gs, player, bidseq, is, infosetkey, actionshere); 
 
   double stratEV = 0.0;
 
@@ -137,11 +156,15 @@ double cfres(GameState & gs, int player, int depth, unsigned long long bidseq, i
 
   // on my nodes, update the regrets
 
+  iss.lock(is); 
+
   if (player == updatePlayer) 
   {
     // q(z) = \pi_{-i} is equal to the sampling probabilty, it cancels with the counterfactual term
-    for (int a = 0; a < actionshere; a++)
-      is.cfr[a] += (moveEVs[a] - stratEV); 
+    if (updates != NULL) 
+      addScaledDiff(updates->regretDelta(buffered), moveEVs, stratEV, 1.0, actionshere); 
+    else
+      addScaledDiff(is.cfrArray(), moveEVs, stratEV, 1.0, actionshere); 
   }
 
   // on opponent node, update the average strategy
@@ -150,20 +173,91 @@ double cfres(GameState & gs, int player, int depth, unsigned long long bidseq, i
   {
     // in stochastically-weighted averaging, divide by likelihood of sampling to here
     // also = \pi_{-i}, so they cancel again
-    for (int a = 0; a < actionshere; a++)
-      is.totalMoveProbs[a] += is.curMoveProbs[a]; 
+    if (updates != NULL) 
+      updates->addAverage(buffered, 1.0); 
+    else
+      addScaled(is.totalMoveProbsArray(), is.curMoveProbs, 1.0, actionshere); 
   }
-  
-  // we're always  updating, so save back to the store
-  iss.put(infosetkey, is, actionshere, 0); 
- 
+
+  // the infoset changed in this iteration (delta checkpoints only save those)
+  if (updates == NULL) 
+    is.setLastUpdate(iter); 
+
+  iss.unlock(is); 
+
   return stratEV;
 }
 
 
+// one sampled traversal for each player, returns the # of nodes touched
+static unsigned long long iteration(int /* thread */)
+{
+  threadNodes = 0;
+
+  GameState gs1; 
+  cfres(gs1, 1, 0, 0, 1); 
+
+  GameState gs2; 
+  cfres(gs2, 1, 0, 0, 2); 
+
+  return threadNodes;
+}
+
+// A thread's iteration in a deterministic round
+struct RoundIteration
+{
+  int thread;
+  unsigned long long nodes;
+
+  void run()
+  {
+    threadUpdates = roundUpdates[thread];
+    threadNodes = 0;
+
+    // thread t runs iteration iter + t
+    setRandStream(randSeed, iter + thread, 1, thread);
+    GameState gs1; 
+    cfres(gs1, 1, 0, 0, 1); 
+
+    setRandStream(randSeed, iter + thread, 2, thread);
+    GameState gs2; 
+    cfres(gs2, 1, 0, 0, 2); 
+
+    endRandStream();
+    threadUpdates = NULL;
+    nodes = threadNodes;
+  }
+};
+
+// With --seed on several threads: every thread runs an iteration from the same strategies, 
+// keeping its updates aside, and these are then added to the store in the order of the 
+// threads. Runs taskThreads iterations and returns the # of nodes touched; the same seed and
+// # of threads always give the same strategies.
+static unsigned long long deterministicRound()
+{
+  vector<RoundIteration> round(taskThreads);
+  TaskGroup group;
+  for (int t = 0; t < taskThreads; t++)
+  {
+    round[t].thread = t;
+    group.spawn(round[t]);
+  }
+  group.wait();
+
+  unsigned long long touched = 0;
+  for (int t = 0; t < taskThreads; t++)
+  {
+    roundUpdates[t]->apply();
+    touched += round[t].nodes;
+  }
+
+  return touched;
+}
+
 int main(int argc, char ** argv) 
 {
   init();
+  parseOptions(argc, argv);
   unsigned long long maxNodesTouched = 0; 
 
   if (argc < 2)
@@ -175,7 +269,7 @@ int main(int argc, char ** argv)
   else
   {
     cout << "Reading infosets from " << argv[1] << endl;
-    if (!iss.readFromDisk(argv[1]))
+    if (!loadCheckpoint(argv[1]))
     {
       cerr << "Problem reading file. " << endl; 
       exit(-1); 
@@ -185,6 +279,9 @@ int main(int argc, char ** argv)
       runname = argv[2];
     else   
       runname = "bluff11";
+
+    if (argc >= 4)
+      initTasks(to_int(argv[3]));
   }
   
   // get the iteration
@@ -207,18 +304,37 @@ int main(int argc, char ** argv)
   }
 
 
-  unsigned long long bidseq = 0; 
-    
+  if (taskThreads > 1)
+  {
+    cout << "Running on " << taskThreads << " threads";
+    if (seeded)
+    {
+      cout << ", deterministically";
+      for (int t = 0; t < taskThreads; t++)
+        roundUpdates.push_back(new UpdateBuffer(4096));
+    }
+    cout << endl;
+  }
+
   double totaltime = 0; 
   StopWatch stopwatch;
 
   for (; true; iter++)
   {
-    GameState gs1; bidseq = 0;
-    cfres(gs1, 1, 0, bidseq, 1); 
-    
-    GameState gs2; bidseq = 0;
-    cfres(gs2, 1, 0, bidseq, 2); 
+    if (taskThreads > 1 && seeded)
+    {
+      nodesTouched += deterministicRound();
+      iter += taskThreads - 1;
+    }
+    else if (taskThreads > 1)
+    {
+      // until the next report
+      runSamplingThreads(iteration, 1, maxNodesTouched > 0 ? MIN(maxNodesTouched, ntNextReport) : ntNextReport);
+    }
+    else 
+    {
+      nodesTouched += iteration(0);
+    }
 
     if (   (maxNodesTouched > 0 && nodesTouched >= maxNodesTouched)
         || (maxNodesTouched == 0 && nodesTouched >= ntNextReport))
@@ -242,8 +358,7 @@ int main(int argc, char ** argv)
       conv = computeBestResponses(false);
       string str = "cfres." + runname + ".report.txt"; 
       report(str, totaltime, 2.0*MAX(b1,b2), conv);
-      //dumpInfosets("iss-" + runname); 
-      //dumpMetaData("metainfo-" + runname, totaltime); 
+      checkpoint(runname, totaltime); 
 
       cout << "Report done at: " << getCurDateTime() << endl;
 
@@ -256,6 +371,8 @@ int main(int argc, char ** argv)
       break;
   }
   
+  finishCheckpoints(); 
+
   return 0;
 }
 
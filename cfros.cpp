@@ -2,8 +2,11 @@
 #include <iostream>
 #include <cassert>
 #include <cstdlib>
+#include <vector>
 
 #include "bluff.h"
+#include "simd.h"
+#include "tasks.h"
 
 // opponent sampling
 
@@ -11,6 +14,9 @@ using namespace std;
 
 static string runname = "";
 
+// trajectories per player in a batch (see TrajectoryBatch)
+static int batchSize = 1;
+
 // This one is slightly different than the algorithm presented in the thesis; it still implements
 // the alternating form, but this one uses stochastically-weighted averaging.
 
@@ -53,7 +59,7 @@ double cfros(GameState & gs, int player, int depth, unsigned long long bidseq,
   }
 
   // declare the variables
-  Infoset is;
+  InfosetView is;
   unsigned long long infosetkey = 0;
   int action = -1;
 
@@ -121,13 +127,15 @@ double cfros(GameState & gs, int player, int depth, unsigned long long bidseq,
   double myreach = (player == 1 ? reach1 : reach2); 
   double oppreach = (player == 1 ? reach2 : reach1); 
  
+  iss.lock(is); 
+
   // update regrets (my infosets only)
   if (player == updatePlayer) 
   { 
     for (int a = 0; a < actionshere; a++)
     {
       // oppreach and sprob2 cancel in the case of stochastically-weighted averaging
-      //is.cfr[a] += (moveEVs[a] - stratEV); 
+      //is.cfr(a) += (moveEVs[a] - stratEV); 
     
       double U = updatePlayerPayoff * oppreach / rtlSampleProb;
       double r = 0.0; 
@@ -136,25 +144,199 @@ double cfros(GameState & gs, int player, int depth, unsigned long long bidseq,
       else 
         r = -U * itlReach;
 
-      is.cfr[a] += r; 
+      storeValue(is.cfr(a), is.cfr(a) + r); 
     }
   }
  
   if (player != updatePlayer) { 
-    // update av. strat
-    for (int a = 0; a < actionshere; a++)
+    // update av. strat, using stochastically-weighted averaging
+    addScaled(is.totalMoveProbsArray(), is.curMoveProbs, (1.0 / (sprob1*sprob2))*myreach, actionshere); 
+  }
+
+  // the infoset changed in this iteration (delta checkpoints only save those)
+  is.setLastUpdate(iter); 
+
+  iss.unlock(is); 
+
+  return updatePlayerPayoff;
+}
+
+// Batched outcome sampling. A batch samples a number of trajectories for the same update player
+// from the strategies at its start, then applies what their updates add up to: each infoset 
+// the batch reaches is got from the store once and updated once. With one trajectory per batch
+// this does exactly what cfros does.
+
+struct BatchStep
+{
+  int infoset;                     // index in the batch's updates
+  int action;                      // the one sampled
+  double reach1, reach2;           // at the node
+  double sprob1, sprob2;
+};
+
+class TrajectoryBatch
+{
+  UpdateBuffer updates; 
+
+  unsigned long long sampleTrajectory(int updatePlayer);
+
+public:
+  // at most one new infoset per step of a trajectory
+  TrajectoryBatch(int trajectories) : updates(trajectories*BLUFFBID) { }
+
+  // samples the trajectories, returns the # of nodes touched
+  unsigned long long sample(int updatePlayer, int trajectories);
+  void apply() { updates.apply(); }
+};
+
+// cfros without the recursion: down to a terminal node and then back up, adding the updates
+// to the batch instead of the store. Returns the # of nodes touched.
+unsigned long long TrajectoryBatch::sampleTrajectory(int updatePlayer)
+{
+  GameState gs;
+  double sampleProb;
+  sampleChanceEvent(1, gs.p1roll, sampleProb);
+  sampleChanceEvent(2, gs.p2roll, sampleProb);
+  unsigned long long touched = 2;
+
+  BatchStep path[BLUFFBID];
+  int steps = 0;
+  int player = 1;
+  unsigned long long bidseq = 0;
+  double reach1 = 1.0, reach2 = 1.0, sprob1 = 1.0, sprob2 = 1.0;
+
+  while (!terminal(gs))
+  {
+    touched++;
+
+    // can't call Bluff as first action when there is no bid
+    int maxBid = (gs.curbid == 0 ? BLUFFBID-1 : BLUFFBID);
+    int actionshere = maxBid - gs.curbid;
+    assert(actionshere > 0 && steps < BLUFFBID);
+
+    BatchStep & step = path[steps++];
+    step.infoset = updates.find(gs, player, bidseq, actionshere);
+    step.reach1 = reach1;
+    step.reach2 = reach2;
+    step.sprob1 = sprob1;
+    step.sprob2 = sprob2;
+
+    // epsilon on-policy at my nodes, on-policy at the opponent's
+    InfosetView & is = updates[step.infoset].is;
+    double sampleprob = -1;
+    step.action = sampleAction(is, actionshere, sampleprob, (player == updatePlayer ? 0.6 : 0.0), false);
+    CHKPROBNZ(sampleprob);
+
+    double moveProb = is.curMoveProbs[step.action];
+    CHKPROB(moveProb);
+    if (player == 1) { reach1 = moveProb*reach1; sprob1 = sampleprob*sprob1; }
+    else             { reach2 = moveProb*reach2; sprob2 = sampleprob*sprob2; }
+
+    int bid = gs.curbid + 1 + step.action;
+    gs.prevbid = gs.curbid;
+    gs.curbid = bid;
+    gs.callingPlayer = player;
+    bidseq |= (1ULL << (BLUFFBID-bid));
+    player = 3-player;
+  }
+
+  double updatePlayerPayoff = payoff(gs, updatePlayer);
+  double rtlSampleProb = sprob1*sprob2;
+  double suffixreach = 1.0;
+
+  for (int s = steps-1; s >= 0; s--)
+  {
+    const BatchStep & step = path[s];
+    BufferedInfoset & bis = updates[step.infoset];
+
+    double ctlReach = suffixreach;
+    double itlReach = suffixreach*bis.is.curMoveProbs[step.action];
+    suffixreach = itlReach;
+
+    double myreach = (bis.player == 1 ? step.reach1 : step.reach2);
+    double oppreach = (bis.player == 1 ? step.reach2 : step.reach1);
+
+    if (bis.player == updatePlayer)
     {
-      // stochastically-weighted averaging
-      double inc = (1.0 / (sprob1*sprob2))*myreach*is.curMoveProbs[a];
-      is.totalMoveProbs[a] += inc; 
+      double U = updatePlayerPayoff * oppreach / rtlSampleProb;
+      double * regrets = updates.regretDelta(step.infoset);
+      for (int a = 0; a < bis.actionshere; a++)
+        regrets[a] += (a == step.action ? U * (ctlReach - itlReach) : -U * itlReach);
     }
+    else
+      updates.addAverage(step.infoset, (1.0 / (step.sprob1*step.sprob2))*myreach);
   }
 
-  // save the infoset back to the store
+  return touched;
+}
+
+unsigned long long TrajectoryBatch::sample(int updatePlayer, int trajectories)
+{
+  unsigned long long touched = 0;
+  for (int k = 0; k < trajectories; k++)
+    touched += sampleTrajectory(updatePlayer);
 
-  iss.put(infosetkey, is, actionshere, 0); 
+  return touched;
+}
 
-  return updatePlayerPayoff;
+static std::vector<TrajectoryBatch *> batches;  // one per thread
+
+// batchSize iterations: a batch for each player
+static unsigned long long batchIteration(int thread)
+{
+  TrajectoryBatch & batch = *batches[thread];
+
+  unsigned long long touched = batch.sample(1, batchSize);
+  batch.apply();
+  touched += batch.sample(2, batchSize);
+  batch.apply();
+  return touched;
+}
+
+// A thread's batch in a deterministic round
+struct RoundBatch
+{
+  int thread;
+  int updatePlayer;
+  unsigned long long nodes;
+
+  void run()
+  {
+    // thread t samples the iterations from iter + t*batchSize on
+    setRandStream(randSeed, iter + thread*batchSize, updatePlayer, thread);
+    nodes = batches[thread]->sample(updatePlayer, batchSize);
+    endRandStream();
+  }
+};
+
+// With --seed on several threads: every thread samples a batch from the same strategies, and
+// the batches are then added to the store in the order of the threads (first for player 1, 
+// then for player 2). Runs taskThreads*batchSize iterations and returns the # of nodes touched;
+// the same seed and # of threads always give the same strategies.
+static unsigned long long deterministicRound()
+{
+  unsigned long long touched = 0;
+  std::vector<RoundBatch> round(taskThreads);
+
+  for (int updatePlayer = 1; updatePlayer <= 2; updatePlayer++)
+  {
+    TaskGroup group;
+    for (int t = 0; t < taskThreads; t++)
+    {
+      round[t].thread = t;
+      round[t].updatePlayer = updatePlayer;
+      group.spawn(round[t]);
+    }
+    group.wait();
+
+    for (int t = 0; t < taskThreads; t++)
+    {
+      batches[t]->apply();
+      touched += round[t].nodes;
+    }
+  }
+
+  return touched;
 }
 
 int main(int argc, char ** argv)
@@ -162,6 +344,7 @@ int main(int argc, char ** argv)
   unsigned long long maxIters = 0; 
   unsigned long long maxNodesTouched = 0; 
   init();
+  parseOptions(argc, argv);
 
   if (argc < 2)
   {
@@ -172,7 +355,7 @@ int main(int argc, char ** argv)
   else
   {
     cout << "Reading infosets from " << argv[1] << endl;
-    if (!iss.readFromDisk(argv[1]))
+    if (!loadCheckpoint(argv[1]))
     {
       cerr << "Problem reading file. " << endl; 
       exit(-1); 
@@ -182,6 +365,12 @@ int main(int argc, char ** argv)
       runname = argv[2];
     else
       runname = "bluff11";
+
+    if (argc >= 4)
+      batchSize = MAX(1, to_int(argv[3]));
+
+    if (argc >= 5)
+      initTasks(to_int(argv[4]));
   }
 
   // get the iteration
@@ -204,6 +393,17 @@ int main(int argc, char ** argv)
   }
   
 
+  bool batched = (batchSize > 1 || taskThreads > 1);
+  if (batched)
+  {
+    cout << "Sampling " << batchSize << " trajectories per player per batch, on " << taskThreads << " thread(s)";
+    if (seeded && taskThreads > 1)
+      cout << ", deterministically";
+    cout << endl;
+    for (int t = 0; t < taskThreads; t++)
+      batches.push_back(new TrajectoryBatch(batchSize));
+  }
+
   unsigned long long bidseq = 0; 
     
   double totaltime = 0; 
@@ -211,15 +411,28 @@ int main(int argc, char ** argv)
 
   for (; true; iter++)
   {
-    GameState gs1; bidseq = 0;
-    double suffixreach = 1.0; 
-    double rtlSampleProb = 1.0; 
-    cfros(gs1, 1, 0, bidseq, 1.0, 1.0, 1.0, 1.0, 1, suffixreach, rtlSampleProb);
+    if (batched && seeded && taskThreads > 1)
+    {
+      nodesTouched += deterministicRound();
+      iter += taskThreads*batchSize - 1;
+    }
+    else if (batched)
+    {
+      // until the next report
+      runSamplingThreads(batchIteration, batchSize, maxNodesTouched > 0 ? MIN(maxNodesTouched, ntNextReport) : ntNextReport);
+    }
+    else
+    {
+      GameState gs1; bidseq = 0;
+      double suffixreach = 1.0; 
+      double rtlSampleProb = 1.0; 
+      cfros(gs1, 1, 0, bidseq, 1.0, 1.0, 1.0, 1.0, 1, suffixreach, rtlSampleProb);
     
-    GameState gs2; bidseq = 0;
-    suffixreach = 1.0; 
-    rtlSampleProb = 1.0; 
-    cfros(gs1, 1, 0, bidseq, 1.0, 1.0, 1.0, 1.0, 2, suffixreach, rtlSampleProb);
+      GameState gs2; bidseq = 0;
+      suffixreach = 1.0; 
+      rtlSampleProb = 1.0; 
+      cfros(gs1, 1, 0, bidseq, 1.0, 1.0, 1.0, 1.0, 2, suffixreach, rtlSampleProb);
+    }
 
     if (   (maxNodesTouched > 0 && nodesTouched >= maxNodesTouched)
         || (maxNodesTouched == 0 && nodesTouched >= ntNextReport))
@@ -246,8 +459,7 @@ int main(int argc, char ** argv)
 
       string str = "cfros." + runname + ".report.txt"; 
       report(str, totaltime, 2.0*MAX(b1,b2), conv);
-      //dumpInfosets("iss-" + runname); 
-      //dumpMetaData("metainfo-" + runname, totaltime); 
+      checkpoint(runname, totaltime); 
       
       cout << "Report done at: " << getCurDateTime() << endl;
 
@@ -262,6 +474,8 @@ int main(int argc, char ** argv)
     }
   }
   
+  finishCheckpoints(); 
+
   return 0;
 }
 
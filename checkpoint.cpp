@@ -0,0 +1,179 @@
+
+/**
+ * Checkpoints written in the background.
+ *
+ * The strategies are copied into a second store (a memcpy, much faster than the disk) and
+ * then written out by another thread while the solver carries on. Only one checkpoint is
+ * written at a time: starting one waits for the previous one to be done.
+ *
+ * Files are named as the solvers expect them for resuming a run:
+ *   scratch/iss-runname.iter.dat and scratch/metainfo-runname.iter.dat
+ *
+ * Only every fullCheckpointEvery-th strategies file is complete. The ones in between are
+ * deltas: just the infosets updated since the previous checkpoint (see 
+ * InfosetStore::dumpDeltaToDisk). loadCheckpoint follows the chain back to the last 
+ * complete file and replays the deltas on top of it. Complete files are compressed unless
+ * compressCheckpoints is turned off (then they can be mapped when resuming).
+ */
+
+#include <list>
+#include <string>
+#include <cstdio>
+#include <iostream>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <pthread.h>
+#endif
+
+#include "bluff.h"
+#include "infosetstore.h"
+
+using namespace std;
+
+unsigned int checkpointsToKeep = 3;
+unsigned int fullCheckpointEvery = 4;
+bool compressCheckpoints = true;
+
+struct CheckpointFile
+{
+  unsigned long long iter;
+  bool full;
+};
+
+static InfosetStore snapshot;          // copy of iss being written
+static string snapshotRunname;
+static MetaData snapshotMetaData;
+static list<CheckpointFile> kept;      // checkpoints on disk, oldest first
+static unsigned int sinceFull = 0;     // # of deltas written since the last complete file
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static pthread_t writer;
+static bool writing = false;
+#endif
+
+static string checkpointFile(string prefix, unsigned long long it)
+{
+  return filepref + prefix + "-" + snapshotRunname + "." + to_string(it) + ".dat";
+}
+
+static void writeCheckpoint()
+{
+  unsigned long long it = snapshotMetaData.iter;
+
+  if (!kept.empty() && kept.back().iter == it)
+    kept.pop_back();
+
+  CheckpointFile cf;
+  cf.iter = it;
+  cf.full = (kept.empty() || sinceFull + 1 >= fullCheckpointEvery);
+
+  if (cf.full && compressCheckpoints)
+  {
+    snapshot.dumpCompressedToDisk(checkpointFile("iss", it));
+    sinceFull = 0;
+  }
+  else if (cf.full)
+  {
+    snapshot.dumpToDisk(checkpointFile("iss", it));
+    sinceFull = 0;
+  }
+  else
+  {
+    // updated after the previous checkpoint was taken
+    snapshot.dumpDeltaToDisk(checkpointFile("iss", it), kept.back().iter);
+    sinceFull++;
+  }
+
+  writeMetaData(checkpointFile("metainfo", it), snapshotMetaData);
+  kept.push_back(cf);
+
+  // drop the old checkpoints, except for the ones that the last checkpointsToKeep need:
+  // everything from the last complete file before them
+  if (checkpointsToKeep > 0 && kept.size() > checkpointsToKeep)
+  {
+    list<CheckpointFile>::iterator needed = kept.end();
+    for (unsigned int i = 0; i < checkpointsToKeep; i++)
+      --needed;
+
+    while (needed != kept.begin() && !needed->full)
+      --needed;
+
+    while (kept.begin() != needed)
+    {
+      remove(checkpointFile("iss", kept.front().iter).c_str());
+      remove(checkpointFile("metainfo", kept.front().iter).c_str());
+      kept.pop_front();
+    }
+  }
+
+  cout << "Checkpoint " << it << " done at: " << getCurDateTime() << endl;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void * writerThread(void *)
+{
+  writeCheckpoint();
+  return NULL;
+}
+#endif
+
+void checkpoint(string runname, double totaltime)
+{
+  finishCheckpoints();
+
+  iss.copy(snapshot);
+  snapshotRunname = runname;
+  getMetaData(snapshotMetaData, totaltime);
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (pthread_create(&writer, NULL, writerThread, NULL) == 0)
+  {
+    writing = true;
+    return;
+  }
+#endif
+
+  // no thread: write it now
+  writeCheckpoint();
+}
+
+bool loadCheckpoint(string filename)
+{
+  unsigned long long since = 0;
+  if (!InfosetStore::isDeltaFile(filename, since))
+    return iss.mapFromDisk(filename);
+
+  // the previous checkpoint has the same name but for the iteration: prefix.iter.dat
+  size_t ext = filename.rfind('.');
+  size_t dot = (ext == string::npos || ext == 0 ? string::npos : filename.rfind('.', ext-1));
+  if (dot == string::npos || dot+1 == ext || filename.find_first_not_of("0123456789", dot+1) != ext)
+  {
+    cerr << "Cannot tell the iteration from " << filename << endl;
+    return false;
+  }
+
+  // each delta is on an earlier checkpoint, so that the chain ends
+  unsigned long long it = to_ull(filename.substr(dot+1, ext-dot-1));
+  if (since >= it)
+  {
+    cerr << filename << " is a delta on iteration " << since << ", not an earlier one" << endl;
+    return false;
+  }
+
+  string prev = filename.substr(0, dot+1) + to_string(since) + filename.substr(ext);
+  cout << filename << " is a delta on " << prev << endl;
+
+  return (loadCheckpoint(prev) && iss.applyDeltaFromDisk(filename));
+}
+
+void finishCheckpoints()
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (writing)
+  {
+    pthread_join(writer, NULL);
+    writing = false;
+  }
+#endif
+}
+
@@ -8,6 +8,7 @@
 #define CHKPROBNZ(x) CHKDBL((x)); assert((x) > 0.0 && (x) <= 1.0)
 #define ABS(x)       ((x) >= 0 ? (x) : (-(x)))
 #define MAX(x,y)     ((x) > (y) ? (x) : (y))
+#define MIN(x,y)     ((x) < (y) ? (x) : (y))
 #define ASSERTEQZERO(x)    assert((ABS((x))) < 0.00000000000001)
 
 //static const size_t SIZE_MAX = std::numeric_limits<std::size_t>::max();
@@ -3,71 +3,654 @@
 #include <cassert>
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <limits>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <malloc.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#endif
+
+#include <zlib.h>
 
 #include "infosetstore.h"
-
-#define ROWS 100
+#include "simd.h"
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// for mbind and get_mempolicy, called directly so as not to need libnuma
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+#ifndef MPOL_F_MEMS_ALLOWED
+#define MPOL_F_MEMS_ALLOWED (1 << 2)
+#endif
+#define NUMA_MAX_NODES 1024
+
+// Strategies files start with this tag and the format version. Files without it were written 
+// by older versions: they have a 5-integer header (the last three were the row split of the
+// table) and the regrets and average strategy of each infoset are interleaved.
+//
+// Version 2 files have a header of ISS_HEADER_CELLS cells (magic, version, index size, size, 
+// value format, then unused ones), followed by the index exactly as it is laid out in memory 
+// and the table.
+// This way the file can be mapped and used as is (see mapFromDisk), and the table starts on a 
+// cache line. Version 1 files have a 4-cell header and an index placed with key % indexSize.
+#define ISS_MAGIC   0x454c49462d535349ULL   // "ISS-FILE"
+#define ISS_VERSION 2ULL
+#define ISS_HEADER_CELLS 8
+
+// Delta files have a header of ISS_HEADER_CELLS cells (magic, version, size of the table they
+// apply to, # of cells that follow, # of infosets, since, value format, then an unused one). 
+// Then, for each 
+// infoset: its position in the table followed by its whole block.
+#define ISS_DELTA_MAGIC   0x544c45442d535349ULL   // "ISS-DELT"
+#define ISS_DELTA_VERSION 1ULL
+
+// Compressed files have a header of ISS_HEADER_CELLS cells (magic, version, index size, size,
+// # of infosets, flags, # of bytes of the encoded index, value format), then a zlib 
+// stream of: the index, as the key and position of each infoset in key order, both as varint
+// deltas from the previous ones (so empty slots cost nothing); then the table, in blocks of 
+// PACK_BLOCK_CELLS cells. With ISS_PACK_SHUFFLE the bytes of each block are grouped by their
+// place in the cell (all first bytes, then all second bytes, ...), which compresses the 
+// doubles much better.
+#define ISS_PACK_MAGIC   0x4b4341502d535349ULL   // "ISS-PACK"
+#define ISS_PACK_VERSION 1ULL
+#define ISS_PACK_SHUFFLE 1ULL
+#define PACK_BLOCK_CELLS 65536ULL
+#define PACK_BUFFER      (1U << 20)
+
+// deflate never makes data more than this many times smaller (what a file's header says it 
+// holds is checked against its size with it)
+#define MAX_INFLATE_RATIO 1032ULL
+
+// How the regrets and average strategy sums are stored (see RegretValue): the low byte is the 
+// # of bytes per value. Files written before the format was stored have 0 there: doubles.
+// VALUES_PACKED is set when blocks have a one-cell header (see BLOCK_HEADER_CELLS).
+#define VALUES_DOUBLE 8ULL
+#define VALUES_FLOAT  4ULL
+#define VALUES_INT    0x104ULL   // signed regrets, unsigned counts
+#define VALUES_TYPE   0xFFFFULL
+#define VALUES_PACKED 0x10000ULL
+
+// Use the direct index only if it needs at most this many entries per hash index slot
+#define DIRECT_INDEX_RATIO 4
+
+// Marks an unused index entry
+#define IS_EMPTY_SLOT 0xFFFFFFFFFFFFFFFFULL
+
+// # of locks the infosets are spread over when updates are locked (see setLocking)
+#define LOCK_STRIPES 4096
+
+// Prefetching is on by default for tables larger than this
+#define PREFETCH_MIN_BYTES (64ULL << 20)
+
+// Buckets of the probe length histogram in getStats (the last one is open)
+#define PROBE_HIST 8
+
+// Initial capacities when none are given to init
+#define DEFAULT_TABLE_SIZE 65536
+#define DEFAULT_INDEX_SIZE 4096
+
+// The index is grown when more than this fraction of it is used
+#define INDEX_MAX_LOAD 0.75
+
+// Slots of the previous index moved to the new one on every insert while growing
+#define MIGRATE_STEP 16
+
+// Bulk file I/O: large reads and writes are split in chunks of this many bytes, handed out 
+// to up to IO_THREADS threads
+#define IO_CHUNK   (64ULL << 20)
+#define IO_THREADS 4
 
 using namespace std;
 
-static unsigned long long totalLookups = 0; 
-static unsigned long long totalMisses = 0; 
+// Lookup statistics for getStats. Each thread counts its own, so that threads looking up 
+// infosets at the same time do not fight over the counters; getStats adds them up. 
+struct LookupCounters
+{
+  unsigned long long lookups; 
+  unsigned long long misses; 
+  LookupCounters * next; 
+};
 
-// First param: total # of doubles needed. 
-//   Should be the total # of (infoset,action) pairs times 2 (2 doubles each)
-// Second param: size of index. 
-//   Should be the max number taken by an infoset key represented as an integer + 1
-void InfosetStore::init(unsigned long long _size, unsigned long long _indexsize)
+static LookupCounters * allCounters = NULL; 
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static __thread LookupCounters * threadCounters = NULL; 
+static pthread_mutex_t countersLock = PTHREAD_MUTEX_INITIALIZER; 
+
+static LookupCounters & lookupCounters()
 {
-  cout << "IS: init" << endl; 
+  if (threadCounters == NULL) 
+  {
+    // kept when the thread is done, so its lookups still count
+    LookupCounters * c = new LookupCounters(); 
+    pthread_mutex_lock(&countersLock); 
+    c->next = allCounters; 
+    allCounters = c; 
+    pthread_mutex_unlock(&countersLock); 
+    threadCounters = c; 
+  }
+
+  return *threadCounters; 
+}
+#else
+static LookupCounters & lookupCounters()
+{
+  static LookupCounters counters; 
+  allCounters = &counters; 
+  return counters; 
+}
+#endif
+
+// The locks of locked updates: a spinlock per cache line, the infoset at pos takes the one
+// its mixed position falls on (so neighbouring infosets rarely share one)
+struct StripeLock
+{
+  volatile int locked; 
+  char pad[64 - sizeof(int)]; 
+};
+
+static StripeLock stripeLocks[LOCK_STRIPES]; 
+
+// The table is one contiguous block of zeroed memory. It is mapped rather than allocated 
+// with new, so pages are only committed when first touched (this is what lets it scale to 
+// the big games without the huge up-front allocation the old row split was avoiding) and 
+// the start of the table is page-aligned. Nothing touches it here, so each page ends up on
+// the NUMA node of the thread that first writes it, unless ISS_ALLOC_INTERLEAVE is asked for.
+//
+// Its length is rounded up to a whole huge page, so that it can be backed by huge pages
+// (see InfosetStore::setAllocation); the rest of the last one is never touched.
+#define HUGE_PAGE_BYTES (2ULL << 20)
+
+static size_t tableBytes(unsigned long long cells)
+{
+  size_t bytes = (cells > 0 ? cells : 1)*sizeof(double); 
+#if defined(_WIN32) || defined(_WIN64)
+  return bytes; 
+#else
+  return (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES; 
+#endif
+}
 
-  size = _size;
-  indexSize = _indexsize; 
+#if !defined(_WIN32) && !defined(_WIN64)
+static void applyAllocation(void * addr, size_t bytes, unsigned int allocation)
+{
+  #ifdef MADV_HUGEPAGE
+  if ((allocation & ISS_ALLOC_THP) && madvise(addr, bytes, MADV_HUGEPAGE) != 0) 
+    cerr << "IS: transparent huge pages are not available" << endl; 
+  #endif
 
-  rowsize = size / (ROWS-1); 
-  lastRowSize = size - rowsize*(ROWS-1);
-  rows = ROWS;
+  #if defined(SYS_mbind) && defined(SYS_get_mempolicy)
+  if (allocation & ISS_ALLOC_INTERLEAVE) 
+  {
+    // over the nodes we are allowed to use
+    unsigned long nodes[NUMA_MAX_NODES / (8*sizeof(unsigned long))]; 
+    memset(nodes, 0, sizeof(nodes)); 
+    int mode = 0; 
+
+    if (   syscall(SYS_get_mempolicy, &mode, nodes, NUMA_MAX_NODES, NULL, MPOL_F_MEMS_ALLOWED) != 0 
+        || syscall(SYS_mbind, addr, bytes, MPOL_INTERLEAVE, nodes, NUMA_MAX_NODES + 1, 0) != 0)
+      cerr << "IS: could not interleave the table over the NUMA nodes" << endl; 
+  }
+  #endif
+}
+#endif
 
-  int i = 0; 
-  while (lastRowSize > rowsize) // will sometimes happen when _size is small 
-  { 
-    i++;
-    rows = ROWS-i;
-    rowsize = size / (rows-1); 
-    lastRowSize = size - rowsize*(rows-1);
+static double * allocTable(unsigned long long cells, unsigned int allocation)
+{
+  size_t bytes = tableBytes(cells); 
+
+#if defined(_WIN32) || defined(_WIN64)
+  (void) allocation; 
+  void * addr = _aligned_malloc(bytes, 64); 
+  assert(addr != NULL); 
+  memset(addr, 0, bytes); 
+#else
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  #ifdef MAP_NORESERVE
+  flags |= MAP_NORESERVE; 
+  #endif
+
+  void * addr = MAP_FAILED; 
+
+  #ifdef MAP_HUGETLB
+  // from the pool of huge pages set aside by the administrator; when there are not enough, 
+  // the table gets regular pages
+  if (allocation & ISS_ALLOC_HUGETLB) 
+  {
+    addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, (flags & ~MAP_NORESERVE) | MAP_HUGETLB, -1, 0); 
+    if (addr == MAP_FAILED) 
+      cerr << "IS: no huge pages for " << bytes << " bytes, using regular pages" << endl; 
   }
+  #endif
 
-  assert(i >= 0 && i <= 99); 
+  if (addr == MAP_FAILED) 
+    addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, -1, 0); 
 
-  cout << "IS: stats " << getStats() << endl;
-  cout << "IS: allocating memory.. " << endl;
+  if (addr == MAP_FAILED) {
+    cerr << "IS: could not map " << bytes << " bytes for the table" << endl;
+    exit(-1); 
+  }
 
-  // allocate the index
-  indexKeys = new unsigned long long [indexSize];
-  indexVals = new unsigned long long [indexSize];
-  for (unsigned long long i = 0; i < indexSize; i++) 
-    indexKeys[i] = indexVals[i] = size;   // used to indicate that no entry is present
+  applyAllocation(addr, bytes, allocation); 
+#endif
+
+  return static_cast<double *>(addr); 
+}
+
+static void freeTable(double * table, unsigned long long cells)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  _aligned_free(table);
+#else
+  munmap(table, tableBytes(cells)); 
+#endif
+}
+
+// Grows or shrinks the table, keeping its contents; new cells are zero
+static double * resizeTable(double * table, unsigned long long oldcells, unsigned long long newcells, 
+                            unsigned int allocation)
+{
+  size_t oldbytes = tableBytes(oldcells); 
+  size_t newbytes = tableBytes(newcells); 
+
+#if defined(_WIN32) || defined(_WIN64)
+  void * addr = _aligned_realloc(table, newbytes, 64); 
+  assert(addr != NULL); 
+  if (newbytes > oldbytes) 
+    memset(static_cast<char *>(addr) + oldbytes, 0, newbytes - oldbytes); 
+#else
+  if (newbytes == oldbytes) 
+    return table; 
+
+  void * addr = MAP_FAILED; 
+  #ifdef MREMAP_MAYMOVE
+  // the kernel moves the pages rather than copying them (the mapping keeps its policy)
+  addr = mremap(table, oldbytes, newbytes, MREMAP_MAYMOVE); 
+  #endif
+
+  // e.g. huge pages on older kernels
+  if (addr == MAP_FAILED) 
+  {
+    addr = allocTable(newcells, allocation); 
+    memcpy(addr, table, (oldbytes < newbytes ? oldbytes : newbytes)); 
+    freeTable(table, oldcells); 
+  }
+#endif
+
+  return static_cast<double *>(addr); 
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+
+static int openForWriting(const string & filename)
+{
+  return _open(filename.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE); 
+}
+
+static int openForReading(const string & filename)
+{
+  return _open(filename.c_str(), _O_RDONLY | _O_BINARY); 
+}
+
+static void closeFile(int fd)
+{
+  _close(fd); 
+}
+
+static unsigned long long fileLength(int fd)
+{
+  long long len = _filelengthi64(fd); 
+  return (len < 0 ? 0ULL : static_cast<unsigned long long>(len)); 
+}
+
+// Reads or writes bytes [offset, offset+bytes) of the file in one go
+static bool bulkIO(int fd, void * buf, unsigned long long bytes, unsigned long long offset, bool writing)
+{
+  char * p = static_cast<char *>(buf); 
+
+  if (_lseeki64(fd, offset, SEEK_SET) < 0) 
+    return false; 
+
+  while (bytes > 0)
+  {
+    unsigned int len = static_cast<unsigned int>(bytes < IO_CHUNK ? bytes : IO_CHUNK); 
+    int n = (writing ? _write(fd, p, len) : _read(fd, p, len)); 
+    if (n <= 0) 
+      return false; 
+    p += n; 
+    bytes -= n; 
+  }
+
+  return true; 
+}
 
-  // allocate the rows 
-  tablerows = new double* [rows];
-  assert(tablerows != NULL);
-  for (unsigned long long i = 0; i < rows; i++) 
+#else
+
+static int openForWriting(const string & filename)
+{
+  return open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644); 
+}
+
+static int openForReading(const string & filename)
+{
+  return open(filename.c_str(), O_RDONLY); 
+}
+
+static void closeFile(int fd)
+{
+  close(fd); 
+}
+
+static unsigned long long fileLength(int fd)
+{
+  struct stat st; 
+  return (fstat(fd, &st) == 0 ? static_cast<unsigned long long>(st.st_size) : 0ULL); 
+}
+
+struct BulkIO
+{
+  int fd; 
+  char * buf; 
+  unsigned long long bytes; 
+  unsigned long long offset; 
+  bool writing; 
+  unsigned long long nextChunk;   // next chunk to be claimed by a thread
+  bool failed; 
+};
+
+static void * bulkIOWorker(void * arg)
+{
+  BulkIO * io = static_cast<BulkIO *>(arg); 
+  unsigned long long chunks = (io->bytes + IO_CHUNK - 1) / IO_CHUNK; 
+
+  for (unsigned long long c = __sync_fetch_and_add(&io->nextChunk, 1ULL); c < chunks; 
+       c = __sync_fetch_and_add(&io->nextChunk, 1ULL))
   {
-    if (i != (rows-1))
+    unsigned long long done = c*IO_CHUNK; 
+    unsigned long long end = (done + IO_CHUNK < io->bytes ? done + IO_CHUNK : io->bytes); 
+
+    while (done < end)
     {
-      tablerows[i] = new double[rowsize];
-      assert(tablerows[i] != NULL);
-      for (unsigned long long j = 0; j < rowsize; j++)
-        tablerows[i][j] = 0.0;
+      // positioned I/O, so the threads do not share a file offset
+      ssize_t n = (io->writing ? pwrite(io->fd, io->buf + done, end - done, io->offset + done)
+                               : pread(io->fd, io->buf + done, end - done, io->offset + done)); 
+      if (n < 0 && errno == EINTR) 
+        continue; 
+      if (n <= 0) 
+      {
+        io->failed = true; 
+        return NULL; 
+      }
+      done += n; 
     }
-    else 
+  }
+
+  return NULL; 
+}
+
+// Reads or writes bytes [offset, offset+bytes) of the file, chunks in parallel
+static bool bulkIO(int fd, void * buf, unsigned long long bytes, unsigned long long offset, bool writing)
+{
+  BulkIO io; 
+  io.fd = fd; 
+  io.buf = static_cast<char *>(buf); 
+  io.bytes = bytes; 
+  io.offset = offset; 
+  io.writing = writing; 
+  io.nextChunk = 0; 
+  io.failed = false; 
+
+  unsigned long long chunks = (bytes + IO_CHUNK - 1) / IO_CHUNK; 
+  pthread_t threads[IO_THREADS]; 
+  int started = 0; 
+
+  for (unsigned long long t = 1; t < chunks && t < IO_THREADS; t++) 
+    if (pthread_create(&threads[started], NULL, bulkIOWorker, &io) == 0) 
+      started++; 
+
+  bulkIOWorker(&io); 
+
+  for (int t = 0; t < started; t++) 
+    pthread_join(threads[t], NULL); 
+
+  return !io.failed; 
+}
+
+#endif
+
+// Streams bytes through zlib into a file
+class PackWriter
+{
+  ofstream out; 
+  z_stream zs; 
+  unsigned char * buf; 
+  bool ok; 
+
+  void drain(int flush)
+  {
+    do 
+    {
+      zs.next_out = buf; 
+      zs.avail_out = PACK_BUFFER; 
+      int ret = deflate(&zs, flush); 
+      if (ret == Z_STREAM_ERROR) 
+        ok = false; 
+      out.write(reinterpret_cast<char *>(buf), PACK_BUFFER - zs.avail_out); 
+    }
+    while (zs.avail_out == 0); 
+  }
+
+public:
+
+  unsigned long long written; 
+
+  PackWriter(const string & filename, const void * header, unsigned int len)
+  {
+    buf = new unsigned char [PACK_BUFFER]; 
+    memset(&zs, 0, sizeof(zs)); 
+    ok = (deflateInit(&zs, Z_BEST_SPEED) == Z_OK); 
+
+    out.open(filename.c_str(), ios::out | ios::binary); 
+    ok = ok && out.is_open(); 
+    out.write(static_cast<const char *>(header), len); 
+  }
+
+  ~PackWriter()
+  {
+    deflateEnd(&zs); 
+    delete [] buf; 
+  }
+
+  void write(const void * data, unsigned int len)
+  {
+    zs.next_in = static_cast<Bytef *>(const_cast<void *>(data)); 
+    zs.avail_in = len; 
+    drain(Z_NO_FLUSH); 
+  }
+
+  bool finish()
+  {
+    zs.avail_in = 0; 
+    drain(Z_FINISH); 
+    written = out.tellp(); 
+    out.close(); 
+    return ok && !out.fail(); 
+  }
+}; 
+
+// Reads bytes back from a zlib stream in a file
+class PackReader
+{
+  ifstream in; 
+  z_stream zs; 
+  unsigned char * buf; 
+
+public:
+
+  bool ok;                      // false once opening, reading or inflating failed
+  unsigned long long fileBytes; 
+
+  PackReader(const string & filename, void * header, unsigned int len)
+  {
+    buf = new unsigned char [PACK_BUFFER]; 
+    memset(&zs, 0, sizeof(zs)); 
+    ok = (inflateInit(&zs) == Z_OK); 
+    fileBytes = 0; 
+
+    in.open(filename.c_str(), ios::in | ios::binary); 
+    if (in.is_open()) 
+    {
+      in.seekg(0, ios::end); 
+      fileBytes = static_cast<unsigned long long>(in.tellg()); 
+      in.seekg(0); 
+    }
+    in.read(static_cast<char *>(header), len); 
+    ok = ok && in.good(); 
+  }
+
+  ~PackReader()
+  {
+    inflateEnd(&zs); 
+    delete [] buf; 
+  }
+
+  bool read(void * data, unsigned int len)
+  {
+    zs.next_out = static_cast<Bytef *>(data); 
+    zs.avail_out = len; 
+
+    while (ok && zs.avail_out > 0)
     {
-      tablerows[i] = new double[lastRowSize];
-      assert(tablerows[i] != NULL);
-      for (unsigned int j = 0; j < lastRowSize; j++)
-        tablerows[i][j] = 0.0;
+      if (zs.avail_in == 0)
+      {
+        in.read(reinterpret_cast<char *>(buf), PACK_BUFFER); 
+        zs.next_in = buf; 
+        zs.avail_in = static_cast<uInt>(in.gcount()); 
+        if (zs.avail_in == 0) 
+          ok = false;   // truncated
+      }
+
+      int ret = inflate(&zs, Z_NO_FLUSH); 
+      if (ret != Z_OK && !(ret == Z_STREAM_END && zs.avail_out == 0)) 
+        ok = false; 
     }
+
+    return ok; 
+  }
+}; 
+
+static void putVarint(vector<unsigned char> & bytes, unsigned long long x)
+{
+  while (x >= 0x80) 
+  {
+    bytes.push_back(static_cast<unsigned char>(x | 0x80)); 
+    x >>= 7; 
+  }
+  bytes.push_back(static_cast<unsigned char>(x)); 
+}
+
+static unsigned long long getVarint(const unsigned char * & p)
+{
+  unsigned long long x = 0; 
+  int shift = 0; 
+  while (*p & 0x80) 
+  {
+    x |= static_cast<unsigned long long>(*p++ & 0x7f) << shift; 
+    shift += 7; 
   }
+  x |= static_cast<unsigned long long>(*p++) << shift; 
+  return x; 
+}
+
+// cells x 8 bytes -> 8 planes of cells bytes, and back
+static void shuffleBytes(const unsigned char * src, unsigned char * dest, unsigned long long cells)
+{
+  for (unsigned long long c = 0; c < cells; c++) 
+    for (int b = 0; b < 8; b++) 
+      dest[b*cells + c] = src[c*8 + b]; 
+}
+
+static void unshuffleBytes(const unsigned char * src, unsigned char * dest, unsigned long long cells)
+{
+  for (int b = 0; b < 8; b++) 
+    for (unsigned long long c = 0; c < cells; c++) 
+      dest[c*8 + b] = src[b*cells + c]; 
+}
+
+static bool byKey(const pair<unsigned long long, unsigned long long> & a, const pair<unsigned long long, unsigned long long> & b)
+{
+  return a.first < b.first; 
+}
+
+static void reportIO(const char * what, const string & filename, unsigned long long bytes, double secs)
+{
+  double mb = bytes / (1024.0*1024.0); 
+  cout << "IS: " << what << " " << filename << ", " << mb << " MB in " << secs << " s (" 
+       << (mb / MAX(secs, 0.001)) << " MB/s)" << endl; 
+}
+
+// Infoset keys are bid bitmasks shifted past the chance outcome bits, so their low bits are 
+// far from uniform. Mix them (this is the 64-bit finalizer of MurmurHash3) before masking.
+static inline unsigned long long mixKey(unsigned long long key)
+{
+  key ^= key >> 33; 
+  key *= 0xff51afd7ed558ccdULL; 
+  key ^= key >> 33; 
+  key *= 0xc4ceb9fe1a85ec53ULL; 
+  key ^= key >> 33; 
+  return key;
+}
+
+static inline void lockStripe(unsigned long long pos)
+{
+  volatile int * l = &stripeLocks[mixKey(pos) & (LOCK_STRIPES - 1)].locked; 
+  while (__sync_lock_test_and_set(l, 1)) 
+    while (*l) 
+      ; 
+}
+
+static inline void unlockStripe(unsigned long long pos)
+{
+  __sync_lock_release(&stripeLocks[mixKey(pos) & (LOCK_STRIPES - 1)].locked); 
+}
+
+// First param: total # of doubles needed. 
+//   Should be the total # of (infoset,action) pairs times 2 (2 doubles each)
+// Second param: size of index. 
+//   Should be larger than the number of infosets (rounded up to a power of 2)
+void InfosetStore::init(unsigned long long _size, unsigned long long _indexsize)
+{
+  cout << "IS: init" << endl; 
+
+  size = (_size > 0 ? _size : DEFAULT_TABLE_SIZE);
+  indexSize = (_indexsize > 0 ? _indexsize : DEFAULT_INDEX_SIZE); 
+
+  cout << "IS: stats " << getStats() << endl;
+  cout << "IS: allocating memory.. " << endl;
+
+  // allocate the index
+  allocIndex(indexSize); 
+
+  // allocate the table (already zeroed)
+  table = allocTable(size, allocation); 
 
   // set to adding information sets
   addingInfosets = true;
@@ -77,531 +660,1425 @@ void InfosetStore::init(unsigned long long _size, unsigned long long _indexsize)
   cout << "IS: init done. " << endl;
 }
 
-string InfosetStore::getStats() 
+void InfosetStore::allocIndex(unsigned long long minsize)
 {
-  string str; 
-  str += (to_string(size) + " "); 
-  str += (to_string(rowsize) + " "); 
-  str += (to_string(rows) + " "); 
-  str += (to_string(lastRowSize) + " "); 
-  str += (to_string(added) + " "); 
-  str += (to_string(nextInfosetPos) + " "); 
-  str += (to_string(totalLookups) + " "); 
-  str += (to_string(totalMisses) + " "); 
+  indexSize = 1; 
+  while (indexSize < minsize) 
+    indexSize *= 2; 
 
-  double avglookups =   static_cast<double>(totalLookups + totalMisses) 
-                      / static_cast<double>(totalLookups); 
+  index = new IndexEntry [indexSize]; 
+  for (unsigned long long i = 0; i < indexSize; i++) 
+  {
+    index[i].key = 0; 
+    index[i].pos = IS_EMPTY_SLOT; 
+  }
+}
 
-  double percent_full = static_cast<double>(nextInfosetPos) /  static_cast<double>(size) * 100.0;  
+void InfosetStore::growIndex()
+{
+  assert(oldIndex == NULL); 
 
-  str += (to_string(avglookups) + " ");
-  str += (to_string(percent_full) + "\% full"); 
-  return str;
+  oldIndex = index; 
+  oldIndexSize = indexSize; 
+  migrated = 0; 
+
+  allocIndex(2*oldIndexSize); 
 }
 
-void InfosetStore::next(unsigned long long & row, unsigned long long & col, unsigned long long & pos, unsigned long long & curRowSize)
+void InfosetStore::migrateIndex(unsigned long long slots)
 {
-  pos++;
-  col++; 
-  
-  if (col >= curRowSize) {
-    col = 0; 
-    row++;
-    curRowSize = (row < (rows-1) ? rowsize : lastRowSize);
+  for (unsigned long long n = 0; n < slots && migrated < oldIndexSize; n++, migrated++) 
+    if (oldIndex[migrated].pos != IS_EMPTY_SLOT) 
+      addToIndex(oldIndex[migrated].key, oldIndex[migrated].pos); 
+
+  if (migrated >= oldIndexSize) 
+  {
+    delete [] oldIndex; 
+    oldIndex = NULL; 
+    oldIndexSize = 0; 
   }
 }
 
-bool InfosetStore::get(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove)
+void InfosetStore::stopAdding()
 {
-  return get_priv(infoset_key, infoset, moves, firstmove);
+  addingInfosets = false; 
+
+  if (oldIndex != NULL) 
+    migrateIndex(oldIndexSize); 
+
+  // give back the part of the table that was not used
+  if (mapping == NULL && nextInfosetPos < size) 
+  {
+    table = resizeTable(table, size, nextInfosetPos, allocation); 
+    size = nextInfosetPos; 
+  }
+
+  buildDirectIndex(); 
+  checkGrouped(); 
 }
 
-void InfosetStore::put(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove)
+void InfosetStore::destroy()
 {
-  put_priv(infoset_key, infoset, moves, firstmove);
-}
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (mapping != NULL) 
+  {
+    // index and table live in the mapping
+    munmap(mapping, mappingBytes); 
+    mapping = NULL; 
+    table = NULL; 
+  }
+#endif
+
+  if (table != NULL)
+  {
+    delete [] index; 
 
+    freeTable(table, size);
+  }
 
-bool InfosetStore::contains(unsigned long long infoset_key)
-{
-  assert(infoset_key < indexSize); 
-  unsigned long long pos = getPosFromIndex(infoset_key); 
-  return (pos >= size ? false : true);
+  if (oldIndex != NULL)
+    delete [] oldIndex; 
+
+  if (directIndex != NULL)
+    delete [] directIndex; 
+
+  if (strategyCache != NULL) 
+    delete [] strategyCache; 
+
+  index = NULL;
+  oldIndex = NULL;
+  table = NULL;
+  directIndex = NULL;
+  strategyCache = NULL;
+  directSize = 0;
+  grouped = false;
+  convertedPos.clear(); 
+  convertedSize = 0;
 }
-  
-unsigned long long InfosetStore::getPosFromIndex(unsigned long long infoset_key)
+
+void InfosetStore::buildDirectIndex()
 {
-  unsigned long long hi = 0;
-  return getPosFromIndex(infoset_key, hi); 
+  // the index is built once the table is complete: is it worth prefetching?
+  prefetching = (size*sizeof(double) > PREFETCH_MIN_BYTES); 
+
+  if (directIndex != NULL)
+    delete [] directIndex; 
+
+  directIndex = NULL;
+  directSize = 0;
+
+  unsigned long long maxKey = 0;
+  for (unsigned long long i = 0; i < indexSize; i++) 
+    if (index[i].pos < size && index[i].key > maxKey) 
+      maxKey = index[i].key;
+
+  // keys too spread out, keep using the hash table
+  if (maxKey >= DIRECT_INDEX_RATIO*indexSize) 
+    return; 
+
+  directSize = maxKey + 1; 
+  directIndex = new unsigned long long [directSize]; 
+  for (unsigned long long k = 0; k < directSize; k++)
+    directIndex[k] = size;  // not present
+
+  for (unsigned long long i = 0; i < indexSize; i++) 
+    if (index[i].pos < size) 
+      directIndex[index[i].key] = index[i].pos; 
+
+  cout << "IS: using a direct index, " << directSize << " entries" << endl;
 }
-  
-unsigned long long InfosetStore::getPosFromIndex(unsigned long long infoset_key, unsigned long long & hashIndex)
+
+void InfosetStore::checkGrouped()
 {
-  unsigned long long start = infoset_key % indexSize; 
-  unsigned long long misses = 0; 
+  grouped = true; 
 
-  for (unsigned long long i = start; misses < indexSize; misses++)
+  for (unsigned long long i = 0; grouped && i < indexSize; i++) 
   {
-    if (indexKeys[i] == infoset_key && indexVals[i] < size) 
-    {
-      // cache hit 
-      totalLookups++; 
-      totalMisses += misses;
-      hashIndex = i; 
-      return indexVals[i]; 
-    }
-    else if (indexVals[i] >= size) // index keys can be >= size since they're arbitrary, but not values!
-    {
-      totalLookups++; 
-      totalMisses += misses;
-      hashIndex = i;
-      return size; 
-    }
-
-    i = i+1; 
-    if (i >= indexSize)
-      i = 0; 
+    unsigned long long key = index[i].key; 
+    if (index[i].pos >= size || ((key >> 1) & ((1ULL << iscWidth) - 1)) != 1) 
+      continue; 
+
+    // the first outcome: the others should follow it
+    int player = static_cast<int>(key & 1) + 1; 
+    unsigned long long cells = blockCells(blockActions(table + index[i].pos)); 
+    for (int o = 1; grouped && o < numChanceOutcomes(player); o++) 
+      grouped = (getPosFromIndex(key + (static_cast<unsigned long long>(o) << 1)) == index[i].pos + o*cells); 
   }
 
-  // should be large enough to hold everything
-  assert(false); 
-  return 0;
+  if (grouped) 
+    cout << "IS: infosets are grouped by bid sequence" << endl;
 }
 
-bool InfosetStore::get_priv(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove)
-{
-  unsigned long long row, col, pos, curRowSize;
+string InfosetStore::getStats() 
+{
+  string str; 
+  str += (to_string(size) + " "); 
+  str += (to_string(added) + " "); 
+  str += (to_string(nextInfosetPos) + " "); 
+  unsigned long long totalLookups = 0, totalMisses = 0; 
+#if !defined(_WIN32) && !defined(_WIN64)
+  pthread_mutex_lock(&countersLock); 
+#endif
+  for (LookupCounters * c = allCounters; c != NULL; c = c->next) 
+  {
+    totalLookups += c->lookups; 
+    totalMisses += c->misses; 
+  }
+#if !defined(_WIN32) && !defined(_WIN64)
+  pthread_mutex_unlock(&countersLock); 
+#endif
+
+  str += (to_string(totalLookups) + " "); 
+  str += (to_string(totalMisses) + " "); 
+
+  // lookups through the direct index are not counted
+  double avglookups =   static_cast<double>(totalLookups + totalMisses) 
+                      / static_cast<double>(MAX(1ULL, totalLookups)); 
+
+  double percent_full = static_cast<double>(nextInfosetPos) /  static_cast<double>(size) * 100.0;  
+
+  str += (to_string(avglookups) + " ");
+  str += (to_string(percent_full) + "\% full"); 
+
+  if (directIndex != NULL) 
+    str += (" direct " + to_string(directSize)); 
+
+  // how far entries sit from their home slot: bucket b counts the keys found in b+1 probes
+  if (index != NULL) 
+  {
+    unsigned long long hist[PROBE_HIST] = { 0 }; 
+    unsigned long long maxprobes = 0; 
+
+    for (unsigned long long i = 0; i < indexSize; i++) 
+    {
+      if (index[i].pos == IS_EMPTY_SLOT) 
+        continue; 
+
+      unsigned long long dist = (i - homeSlot(index[i].key)) & (indexSize - 1); 
+      hist[dist < PROBE_HIST ? dist : PROBE_HIST-1]++; 
+      maxprobes = MAX(maxprobes, dist + 1); 
+    }
+
+    str += " probes"; 
+    for (int b = 0; b < PROBE_HIST; b++) 
+      str += (" " + to_string(b+1) + (b == PROBE_HIST-1 ? "+" : "") + ":" + to_string(hist[b])); 
+    str += (" max:" + to_string(maxprobes)); 
+  }
+
+  return str;
+}
+
+bool InfosetStore::get(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove, bool match)
+{
+  return get_priv(infoset_key, infoset, moves, firstmove, match);
+}
+
+void InfosetStore::put(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove)
+{
+  put_priv(infoset_key, infoset, moves, firstmove);
+}
+
+
+bool InfosetStore::contains(unsigned long long infoset_key)
+{
+  unsigned long long pos = getPosFromIndex(infoset_key); 
+  return (pos >= size ? false : true);
+}
+  
+unsigned long long InfosetStore::getPosFromIndex(unsigned long long infoset_key)
+{
+  if (directIndex != NULL)
+    return (infoset_key < directSize ? directIndex[infoset_key] : size); 
+
+  unsigned long long pos = findInIndex(index, indexSize, infoset_key); 
+
+  // while growing, entries not moved yet are still in the previous index
+  if (pos == IS_EMPTY_SLOT && oldIndex != NULL) 
+    pos = findInIndex(oldIndex, oldIndexSize, infoset_key); 
+
+  return (pos == IS_EMPTY_SLOT ? size : pos); 
+}
+
+unsigned long long InfosetStore::findInIndex(const IndexEntry * idx, unsigned long long idxsize, 
+                                             unsigned long long infoset_key, bool count)
+{
+  unsigned long long mask = idxsize - 1; 
+  unsigned long long i = mixKey(infoset_key) & mask; 
+
+  for (unsigned long long misses = 0; misses < idxsize; misses++)
+  {
+    const IndexEntry & entry = idx[i]; 
+
+    if (entry.pos != IS_EMPTY_SLOT && entry.key == infoset_key)
+    {
+      // cache hit 
+      if (count) 
+      {
+        LookupCounters & c = lookupCounters(); 
+        c.lookups++; 
+        c.misses += misses;
+      }
+      return entry.pos; 
+    }
+    
+    // an empty slot, or an entry closer to its home than we are to ours: the key would 
+    // have been placed here, so it is not in the table
+    if (entry.pos == IS_EMPTY_SLOT || ((i - mixKey(entry.key)) & mask) < misses)
+    {
+      if (count) 
+      {
+        LookupCounters & c = lookupCounters(); 
+        c.lookups++; 
+        c.misses += misses;
+      }
+      return IS_EMPTY_SLOT; 
+    }
+
+    i = (i + 1) & mask; 
+  }
+
+  return IS_EMPTY_SLOT;
+}
+
+unsigned long long InfosetStore::homeSlot(unsigned long long infoset_key)
+{
+  return mixKey(infoset_key) & (indexSize - 1); 
+}
+
+void InfosetStore::addToIndex(unsigned long long infoset_key, unsigned long long pos)
+{
+  unsigned long long mask = indexSize - 1; 
+  unsigned long long i = homeSlot(infoset_key); 
+  unsigned long long dist = 0;
+
+  IndexEntry entry; 
+  entry.key = infoset_key; 
+  entry.pos = pos; 
+
+  for (unsigned long long n = 0; n < indexSize; n++)
+  {
+    if (index[i].pos == IS_EMPTY_SLOT) 
+    {
+      index[i] = entry; 
+      return;
+    }
+
+    // Robin Hood: take the slot from entries that are closer to their home, and carry on
+    // inserting the displaced one
+    unsigned long long curdist = (i - homeSlot(index[i].key)) & mask; 
+    if (curdist < dist) 
+    {
+      IndexEntry tmp = index[i]; 
+      index[i] = entry; 
+      entry = tmp; 
+      dist = curdist; 
+    }
+
+    i = (i + 1) & mask; 
+    dist++; 
+  }
+
+  // should be large enough to hold everything
+  assert(false); 
+}
+
+// files from older versions store cfr[a], totalMoveProbs[a] pairs; rearrange to the current layout
+static void deinterleave(double * block, int moves)
+{
+  double tmp[2*BLUFFBID]; 
+
+  for (int a = 0; a < moves; a++)
+  {
+    tmp[a] = block[2 + 2*a]; 
+    tmp[moves + a] = block[3 + 2*a]; 
+  }
+
+  memcpy(block + 2, tmp, 2*moves*sizeof(double)); 
+}
+
+// the value format of this build
+static unsigned long long ourValues()
+{
+  unsigned long long packed = (BLOCK_HEADER_CELLS == 1 ? VALUES_PACKED : 0ULL); 
+  if (numeric_limits<RegretValue>::is_integer) 
+    return VALUES_INT | packed; 
+  return (sizeof(RegretValue) == sizeof(float) ? VALUES_FLOAT : VALUES_DOUBLE) | packed; 
+}
+
+static unsigned long long valueFormatOf(unsigned long long headerCell)
+{
+  return (headerCell == 0 ? VALUES_DOUBLE : headerCell); 
+}
+
+static unsigned long long headerCellsOf(unsigned long long valueFormat)
+{
+  return ((valueFormat & VALUES_PACKED) != 0 ? 1 : 2); 
+}
+
+static string valueFormatName(unsigned long long valueFormat)
+{
+  unsigned long long type = (valueFormat & VALUES_TYPE); 
+  return string(type == VALUES_INT ? "integer" : type == VALUES_FLOAT ? "float" : "double") 
+         + ((valueFormat & VALUES_PACKED) != 0 ? " (packed)" : ""); 
+}
+
+// a regret or average strategy sum stored in a file in this format
+static double readValue(const unsigned char * p, unsigned long long valueFormat, bool regret)
+{
+  valueFormat &= VALUES_TYPE; 
+  if (valueFormat == VALUES_INT && regret) 
+  {
+    int r; 
+    memcpy(&r, p, sizeof(r)); 
+    return r; 
+  }
+  else if (valueFormat == VALUES_INT) 
+  {
+    unsigned int n; 
+    memcpy(&n, p, sizeof(n)); 
+    return n; 
+  }
+  else if (valueFormat == VALUES_FLOAT) 
+  {
+    float f; 
+    memcpy(&f, p, sizeof(f)); 
+    return f; 
+  }
+
+  double d; 
+  memcpy(&d, p, sizeof(d)); 
+  return d; 
+}
+
+// # of cells of a block in a file in this format (blockCells for ours)
+static unsigned long long fileBlockCells(unsigned long long actions, unsigned long long valueFormat)
+{
+  return headerCellsOf(valueFormat) + (2*actions*(valueFormat & 0xFF) + 7)/8; 
+}
+
+// copies a block from a file with values in another format
+static void convertBlock(double * dst, const double * src, unsigned long long valueFormat)
+{
+  unsigned long long headerCells = headerCellsOf(valueFormat); 
+  unsigned long long actionshere = blockActions(src, headerCells); 
+  setBlockHeader(dst, actionshere, blockLastUpdate(src, headerCells)); 
+
+  const unsigned char * from = reinterpret_cast<const unsigned char *>(src + headerCells); 
+  unsigned long long bytes = (valueFormat & 0xFF); 
+  RegretValue * regrets = reinterpret_cast<RegretValue *>(dst + BLOCK_HEADER_CELLS); 
+  AvgValue * avgs = reinterpret_cast<AvgValue *>(regrets + actionshere); 
+  for (unsigned long long a = 0; a < actionshere; a++) 
+  {
+    storeValue(regrets[a], readValue(from + a*bytes, valueFormat, true)); 
+    storeValue(avgs[a], readValue(from + (actionshere + a)*bytes, valueFormat, false)); 
+  }
+}
+
+void InfosetStore::convertValues(unsigned long long fileFormat)
+{
+  // blocks are laid out again in the same order, so positions of the index are updated
+  vector< pair<unsigned long long, unsigned long long> > blocks;   // position, index slot
+  unsigned long long newsize = 0; 
+  for (unsigned long long i = 0; i < indexSize; i++) 
+  {
+    if (index[i].pos >= size) 
+      continue; 
+
+    unsigned long long actionshere = blockActions(table + index[i].pos, headerCellsOf(fileFormat)); 
+    blocks.push_back(make_pair(index[i].pos, i)); 
+    newsize += blockCells(actionshere); 
+  }
+  sort(blocks.begin(), blocks.end()); 
+
+  double * newtable = allocTable(newsize, allocation); 
+  unsigned long long newpos = 0; 
+  convertedPos.clear(); 
+  for (size_t b = 0; b < blocks.size(); b++) 
+  {
+    unsigned long long actionshere = blockActions(table + blocks[b].first, headerCellsOf(fileFormat)); 
+    convertBlock(newtable + newpos, table + blocks[b].first, fileFormat); 
+
+    index[blocks[b].second].pos = newpos; 
+    convertedPos.push_back(make_pair(blocks[b].first, newpos)); 
+    newpos += blockCells(actionshere); 
+  }
+
+  freeTable(table, size); 
+  convertedSize = size; 
+  table = newtable; 
+  size = newsize; 
+
+  cout << "IS: converted " << blocks.size() << " infosets from " << valueFormatName(fileFormat) << " to " 
+       << valueFormatName(ourValues()) << " values" << endl; 
+}
+
+bool InfosetStore::getView(unsigned long long infoset_key, InfosetView & view, int moves, bool match)
+{
+  unsigned long long pos = getPosFromIndex(infoset_key);  // uses a hash table
+  if (pos >= size) return false;
+
+  assert(pos + blockCells(moves) <= size); 
+  view.block = table + pos;
+
+  // the caller knows the # of actions already
+  view.actionshere = moves; 
+  assert(blockActions(view.block) == static_cast<unsigned long long>(moves));
+
+  matchView(view, pos, match); 
+
+  return true;
+}
+
+// the key of the infoset of the first chance outcome (see getInfosetKey); the others follow by 2
+static inline unsigned long long firstOutcomeKey(unsigned long long bidseq, int player)
+{
+  return (((bidseq << iscWidth) | 1ULL) << 1) | (player == 2 ? 1ULL : 0ULL); 
+}
+
+void InfosetStore::prefetchSlot(unsigned long long infoset_key)
+{
+  if (directIndex != NULL) 
+  {
+    if (infoset_key < directSize) 
+      __builtin_prefetch(directIndex + infoset_key); 
+  }
+  else 
+    __builtin_prefetch(index + homeSlot(infoset_key)); 
+}
+
+void InfosetStore::prefetchBlocks(unsigned long long infoset_key, unsigned long long cells)
+{
+  unsigned long long pos = size; 
+  if (directIndex != NULL) 
+    pos = (infoset_key < directSize ? directIndex[infoset_key] : size); 
+  else 
+    pos = findInIndex(index, indexSize, infoset_key, false); 
+
+  if (pos >= size) 
+    return; 
+
+  // every cache line the blocks touch
+  const char * p = reinterpret_cast<const char *>(table + pos); 
+  const char * end = reinterpret_cast<const char *>(table + MIN(pos + cells, size)); 
+  for (p -= (reinterpret_cast<size_t>(p) & 63); p < end; p += 64) 
+    __builtin_prefetch(p); 
+}
+
+void InfosetStore::prefetchGroup(unsigned long long bidseq, int player, int moves)
+{
+  // only the first one if they are not together
+  prefetchBlocks(firstOutcomeKey(bidseq, player), (grouped ? numChanceOutcomes(player) : 1)*blockCells(moves)); 
+}
+
+int InfosetStore::getAll(unsigned long long bidseq, int player, InfosetView * views, int moves, bool match)
+{
+  unsigned long long key = firstOutcomeKey(bidseq, player); 
+  unsigned long long pos = getPosFromIndex(key); 
+  if (pos >= size) return 0; 
+
+  int co = numChanceOutcomes(player); 
+  unsigned long long cells = blockCells(moves); 
+  for (int o = 0; o < co; o++) 
+  {
+    unsigned long long opos = (grouped ? pos + o*cells : getPosFromIndex(key + (static_cast<unsigned long long>(o) << 1))); 
+    assert(opos + cells <= size); 
+
+    views[o].block = table + opos; 
+    views[o].actionshere = moves; 
+    assert(blockActions(views[o].block) == static_cast<unsigned long long>(moves));
+
+    matchView(views[o], opos, match); 
+  }
+
+  return co; 
+}
+
+void InfosetStore::matchView(InfosetView & view, unsigned long long pos, bool match)
+{
+  // even when not matching, so that the entry can be invalidated through the view
+  view.cached = (strategyCache != NULL ? strategyCache + pos : NULL); 
+  if (!match) 
+    return; 
+
+  // the regrets (and cache entry) may be being updated by another thread
+  if (locking) 
+    lockStripe(pos); 
+
+  if (view.cached == NULL) 
+    regretMatching(view.cfrArray(), view.curMoveProbs, view.actionshere); 
+  else 
+  {
+    // threads that only read the regrets can share entries (e.g. the opponent's, in parallel 
+    // Vanilla CFR): the flag is set once the strategy is written, and read before it. Two 
+    // threads may both fill an entry; only final values are written to it, the same ones.
+    double valid = 0.0; 
+    __atomic_load(view.cached, &valid, __ATOMIC_ACQUIRE); 
+    if (valid == 0.0) 
+    {
+      regretMatching(view.cfrArray(), view.curMoveProbs, view.actionshere); 
+      memcpy(view.cached + 1, view.curMoveProbs, view.actionshere*sizeof(double)); 
+      valid = 1.0; 
+      __atomic_store(view.cached, &valid, __ATOMIC_RELEASE); 
+    }
+    else 
+      memcpy(view.curMoveProbs, view.cached + 1, view.actionshere*sizeof(double)); 
+  }
+
+  if (locking) 
+    unlockStripe(pos); 
+}
+
+void InfosetStore::setAllocation(unsigned int _allocation)
+{
+  allocation = _allocation; 
+}
+
+void InfosetStore::setLocking(bool on)
+{
+  locking = on; 
+}
+
+void InfosetStore::lock(const InfosetView & view)
+{
+  if (locking) 
+    lockStripe(view.block - table); 
+}
+
+void InfosetStore::unlock(const InfosetView & view)
+{
+  if (locking) 
+    unlockStripe(view.block - table); 
+}
+
+void InfosetStore::cacheStrategies()
+{
+  // blocks never have fewer cells than actions + 1, so every entry fits in the block's cells
+  assert(!addingInfosets); 
+  if (strategyCache == NULL) 
+    strategyCache = new double [size]; 
+
+  invalidateStrategies(); 
+}
+
+void InfosetStore::invalidateStrategies()
+{
+  if (strategyCache != NULL) 
+    memset(strategyCache, 0, size*sizeof(double)); 
+}
+
+bool InfosetStore::get_priv(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove, bool match)
+{
+  unsigned long long pos = getPosFromIndex(infoset_key);  // uses a hash table
+  if (pos >= size) return false;
+
+  assert(pos + blockCells(moves) <= size); 
+  double * block = table + pos; 
+
+  if (locking) 
+    lockStripe(pos); 
+
+  // the number of moves is known; get the lastupdate
+  infoset.actionshere = moves; 
+  assert(blockActions(block) == static_cast<unsigned long long>(moves));
+  infoset.lastUpdate = blockLastUpdate(block); 
+
+  const RegretValue * regrets = reinterpret_cast<const RegretValue *>(block + BLOCK_HEADER_CELLS); 
+  const AvgValue * avgs = reinterpret_cast<const AvgValue *>(regrets + moves); 
+  for (int i = 0, m = firstmove; i < moves; i++, m++) 
+  {
+    infoset.cfr[m] = regrets[i]; 
+    infoset.totalMoveProbs[m] = avgs[i]; 
+  }
+
+  if (locking) 
+    unlockStripe(pos); 
+
+  // now do the usual regret matching to get the curMoveProbs
+  if (match) 
+    regretMatching(infoset.cfr + firstmove, infoset.curMoveProbs + firstmove, moves); 
+
+  return true;
+}
+
+void InfosetStore::put_priv(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove)
+{
+  unsigned long long pos;
+
+  assert(moves > 0);
+  bool newinfoset = false; 
+
+  unsigned long long thepos = getPosFromIndex(infoset_key);  
+  if (addingInfosets && thepos >= size)
+  {
+    newinfoset = true; 
+
+    // new infoset to be added at the end; make room for it if needed
+    if (nextInfosetPos + blockCells(moves) > size) 
+    {
+      unsigned long long newsize = MAX(2*size, nextInfosetPos + blockCells(moves)); 
+      table = resizeTable(table, size, newsize, allocation); 
+      size = newsize; 
+    }
+
+    // only add it if it's a new info set
+    pos = nextInfosetPos;
+    
+    //index[infoset_key] = pos;
+    assert(pos < size); 
+    if (oldIndex != NULL) 
+      migrateIndex(MIGRATE_STEP); 
+    else if (added + 1 > INDEX_MAX_LOAD*indexSize) 
+      growIndex(); 
+    addToIndex(infoset_key, pos); 
+
+    //cout << "Adding infosetkey: " << infoset_key << endl; 
+  }
+  else 
+  {
+    // we've seen this one before, load it
+    newinfoset = false; 
+
+    //pos = index[infoset_key];
+    assert(thepos < size); 
+    pos = thepos; 
+  }
+  
+  if (pos + blockCells(moves) > size) {
+    cout << "iss stats: " << iss.getStats() << endl;
+  }
+  assert(pos + blockCells(moves) <= size); 
+  double * block = table + pos; 
+
+  // infosets are only added by one thread
+  bool locked = (locking && !addingInfosets); 
+  if (locked) 
+    lockStripe(pos); 
+
+  // store the number of moves at this infoset and its last update iter
+  assert(moves < 256); 
+  setBlockHeader(block, moves, infoset.lastUpdate); 
+  if (strategyCache != NULL) 
+    strategyCache[pos] = 0.0; 
+
+  // moves are from 1 to moves, so write them in order. 
+  // first all the regrets, then the avg. strat
+  RegretValue * regrets = reinterpret_cast<RegretValue *>(block + BLOCK_HEADER_CELLS); 
+  AvgValue * avgs = reinterpret_cast<AvgValue *>(regrets + moves); 
+  for (int i = 0, m = firstmove; i < moves; i++, m++) 
+  { 
+    CHKDBL(infoset.cfr[m]); 
+    storeValue(regrets[i], infoset.cfr[m]);
+    storeValue(avgs[i], infoset.totalMoveProbs[m]);
+  }
+
+  if (locked) 
+    unlockStripe(pos); 
+
+  if (newinfoset && addingInfosets)
+  {
+    nextInfosetPos = pos + blockCells(moves);
+    added++;
+  }
+}
+  
+void InfosetStore::printValues()
+{
+  for (unsigned int i = 0; i < indexSize; i++) 
+  {
+    if (index[i].pos < size) 
+    {
+      // this is a valid position
+      double * block = table + index[i].pos; 
+
+      cout << "infosetkey = " << index[i].key; 
+      cout << ", infosetkey_str = " << infosetkey_to_string(index[i].key);
+
+      // read # actions and the last update
+      unsigned long long actionshere = blockActions(block);
+      unsigned long long lastUpdate = blockLastUpdate(block);
+
+      cout << ", actions = " << actionshere << ", lastUpdate = " << lastUpdate << endl;
+
+      const RegretValue * regrets = reinterpret_cast<const RegretValue *>(block + BLOCK_HEADER_CELLS); 
+      const AvgValue * avgs = reinterpret_cast<const AvgValue *>(regrets + actionshere); 
+      for (unsigned long long a = 0; a < actionshere; a++) 
+      {
+        cout << "  cfr[" << a << "]=" << regrets[a]; 
+        cout << "  tmp[" << a << "]=" << avgs[a]; 
+        cout << endl;
+      }
+
+      cout << endl;
+    }
+  }
+}
+
+void InfosetStore::clear()
+{
+  for (unsigned int i = 0; i < indexSize; i++) 
+  {
+    if (index[i].pos < size) 
+    {
+      // this is a valid position
+      double * block = table + index[i].pos; 
+
+      // read # actions
+      unsigned long long actionshere = blockActions(block);
+      
+      // the last update, then cfr and total move probs
+      setBlockLastUpdate(block, 0); 
+      memset(block + BLOCK_HEADER_CELLS, 0, (blockCells(actionshere) - BLOCK_HEADER_CELLS)*8); 
+    }
+  }
+
+  invalidateStrategies(); 
+}
+
+void InfosetStore::computeBound(double & sum_RTimm1, double & sum_RTimm2)
+{
+  for (unsigned int i = 0; i < indexSize; i++) 
+  {
+    if (index[i].pos < size) 
+    {
+      // which player is it?
+      unsigned long long key = index[i].key; 
+      double & b = (key % 2 == 0 ? sum_RTimm1 : sum_RTimm2); 
+
+      // this is a valid position
+      double * block = table + index[i].pos; 
+
+      // read # actions
+      unsigned long long actionshere = blockActions(block);
+
+      const RegretValue * regrets = reinterpret_cast<const RegretValue *>(block + BLOCK_HEADER_CELLS); 
+      double max = NEGINF;
+      for (unsigned long long a = 0; a < actionshere; a++) 
+      {
+        double cfr = regrets[a]; 
+        CHKDBL(cfr);
+        if (cfr > max)
+          max = cfr; 
+      }
+
+      assert(max > NEGINF);
+
+      double delta = max; 
+      delta = MAX(0.0, delta); 
+
+      b += delta; 
+    }
+  }
+
+  sum_RTimm1 /= static_cast<double>(iter); 
+  sum_RTimm2 /= static_cast<double>(iter); 
+}
+
+void InfosetStore::roundToFloat()
+{
+  for (unsigned long long i = 0; i < indexSize; i++) 
+  {
+    if (index[i].pos >= size) 
+      continue; 
+
+    double * block = table + index[i].pos; 
+    unsigned long long actionshere = blockActions(block); 
+
+    RegretValue * regrets = reinterpret_cast<RegretValue *>(block + BLOCK_HEADER_CELLS); 
+    AvgValue * avgs = reinterpret_cast<AvgValue *>(regrets + actionshere); 
+    for (unsigned long long a = 0; a < actionshere; a++) 
+    {
+      storeValue(regrets[a], toStoreFloat(regrets[a])); 
+      storeValue(avgs[a], toStoreFloat(avgs[a])); 
+    }
+  }
+
+  invalidateStrategies(); 
+}
+
+
+
+void InfosetStore::writeBytes(std::ofstream & out, void * addr, unsigned int num)
+{
+  out.write(reinterpret_cast<const char *>(addr), num); 
+}
+
+void InfosetStore::readBytes(std::ifstream & in, void * addr, unsigned int num)  
+{
+  in.read(reinterpret_cast<char *>(addr), num); 
+}
+
+// Reads the header of a strategies file. Returns its length in 8-byte cells.
+unsigned long long InfosetStore::readHeader(std::ifstream & in, unsigned long long & idxsize, unsigned long long & tblsize, 
+                                            bool & legacy, unsigned long long & valueFormat)
+{
+  unsigned long long magic = 0, version = 0; 
+  readBytes(in, &magic, 8); 
+
+  if (magic != ISS_MAGIC)
+  {
+    // old format: index size, size, rowsize, rows, last row size
+    unsigned long long rowinfo[3];
+    legacy = true; 
+    valueFormat = VALUES_DOUBLE; 
+    idxsize = magic; 
+    readBytes(in, &tblsize, 8); 
+    readBytes(in, rowinfo, 3*8); 
+    return 5; 
+  }
+
+  readBytes(in, &version, 8); 
+  if (version != 1 && version != ISS_VERSION) 
+  {
+    cerr << "IS: unknown strategies file version " << version << endl; 
+    exit(-1); 
+  }
+
+  legacy = false; 
+  readBytes(in, &idxsize, 8); 
+  readBytes(in, &tblsize, 8); 
+
+  valueFormat = VALUES_DOUBLE; 
+  if (version == 1) 
+    return 4; 
+
+  unsigned long long rest[ISS_HEADER_CELLS-4]; 
+  readBytes(in, rest, (ISS_HEADER_CELLS-4)*8); 
+
+  valueFormat = valueFormatOf(rest[0]); 
+  unsigned long long type = (valueFormat & VALUES_TYPE); 
+  if ((type != VALUES_DOUBLE && type != VALUES_FLOAT && type != VALUES_INT) 
+      || (valueFormat & ~(VALUES_TYPE | VALUES_PACKED)) != 0) 
+  {
+    cerr << "IS: unknown value format " << valueFormat << " in strategies file" << endl; 
+    exit(-1); 
+  }
+
+  return ISS_HEADER_CELLS; 
+}
+
+void InfosetStore::dumpToDisk(std::string filename) 
+{
+  // the file is the store: flushing it is all there is to do
+  if (mapping != NULL && mappingShared && filename == mappedFile) 
+  {
+    StopWatch sw; 
+    syncToDisk(); 
+    reportIO("synced", filename, mappingBytes, sw.stop()); 
+    return; 
+  }
+
+  StopWatch sw; 
+
+  // written under another name and then renamed, so that a store mapped from the old file
+  // (and anyone else reading it) keeps seeing a complete file
+  string tmpname = filename + ".tmp"; 
+  int fd = openForWriting(tmpname); 
+  assert(fd >= 0); 
+
+  assert(sizeof(unsigned long long) == 8); 
+  assert(sizeof(double) == 8);
+  assert(sizeof(IndexEntry) == 16);
+
+  // some integers
+  unsigned long long header[ISS_HEADER_CELLS] = { ISS_MAGIC, ISS_VERSION, indexSize, size, ourValues() }; 
+  unsigned long long offset = 0; 
+  bool ok = bulkIO(fd, header, ISS_HEADER_CELLS*8, offset, true); 
+  offset += ISS_HEADER_CELLS*8; 
+
+  // the index (empty entries have a position >= size)
+  ok = ok && bulkIO(fd, index, indexSize*sizeof(IndexEntry), offset, true); 
+  offset += indexSize*sizeof(IndexEntry); 
+
+  // the table
+  ok = ok && bulkIO(fd, table, size*sizeof(double), offset, true); 
+  offset += size*sizeof(double); 
+
+  closeFile(fd); 
+
+  if (!ok) 
+  {
+    cerr << "IS: error writing " << tmpname << endl; 
+    return; 
+  }
+
+#if defined(_WIN32) || defined(_WIN64)
+  remove(filename.c_str()); 
+#endif
+  if (rename(tmpname.c_str(), filename.c_str()) != 0) 
+    cerr << "IS: could not rename " << tmpname << " to " << filename << endl; 
+
+  reportIO("wrote", filename, offset, sw.stop()); 
+}
+
+bool InfosetStore::mapFromDisk(std::string filename, bool shared)
+{
+#if defined(_WIN32) || defined(_WIN64)
+  return readFromDisk(filename); 
+#else
+  ifstream in(filename.c_str(), ios::in | ios::binary); 
+  if (!in.is_open())
+    return false; 
+
+  bool legacy = false; 
+  unsigned long long fIndexSize = 0, fSize = 0, fValueFormat = 0; 
+  unsigned long long hdrsize = readHeader(in, fIndexSize, fSize, legacy, fValueFormat); 
+  in.close(); 
+
+  // only the current format, with values of our width, can be used in place
+  if (hdrsize != ISS_HEADER_CELLS || fIndexSize == 0 || (fIndexSize & (fIndexSize-1)) != 0 
+      || fValueFormat != ourValues()) 
+  {
+    cout << "IS: " << filename << " cannot be mapped (compressed, older format or other value format), reading it instead" << endl;
+    return readFromDisk(filename); 
+  }
+
+  int fd = open(filename.c_str(), (shared ? O_RDWR : O_RDONLY)); 
+  if (fd < 0) 
+    return false; 
+
+  struct stat st; 
+  size_t bytes = (ISS_HEADER_CELLS + 2*fIndexSize + fSize)*8; 
+  if (fstat(fd, &st) != 0 || static_cast<unsigned long long>(st.st_size) < bytes) 
+  {
+    cerr << "IS: " << filename << " is truncated" << endl; 
+    close(fd); 
+    return false; 
+  }
+
+  // a private mapping is copy-on-write: the solver can update the strategies but the 
+  // file is left as is
+  void * addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, (shared ? MAP_SHARED : MAP_PRIVATE), fd, 0); 
+  close(fd); 
+  if (addr == MAP_FAILED) 
+  {
+    cerr << "IS: could not map " << filename << endl; 
+    return false; 
+  }
 
-  pos = getPosFromIndex(infoset_key);  // uses a hash table
-  if (pos >= size) return false;
+  destroy(); 
 
-  row = pos / rowsize;
-  col = pos % rowsize;
-  curRowSize = (row < (rows-1) ? rowsize : lastRowSize);
-
-  // get the number of moves
-  assert(row < rows); assert(col < curRowSize); assert(pos < size); 
-  unsigned long long x; 
-  double y = tablerows[row][col];
-  assert(sizeof(x) == sizeof(double));
-  memcpy(&x, &y, sizeof(x)); 
-  infoset.actionshere = static_cast<int>(x); 
-  assert(infoset.actionshere > 0);
-  next(row, col, pos, curRowSize);
-  
-  // get the lastupdate
-  assert(row < rows); assert(col < curRowSize);  assert(pos < size); 
-  y = tablerows[row][col];
-  assert(sizeof(x) == sizeof(double));
-  memcpy(&x, &y, sizeof(x)); 
-  infoset.lastUpdate = x; 
-  next(row, col, pos, curRowSize);
-
-  for (int i = 0, m = firstmove; i < moves; i++,m++) 
-  {
-    assert(row < rows);
-    assert(col < curRowSize); 
-    assert(pos < size); 
-    infoset.cfr[m] = tablerows[row][col];
+  mapping = static_cast<char *>(addr); 
+  mappingBytes = bytes; 
+  mappingShared = shared; 
+  mappedFile = filename; 
 
-    next(row, col, pos, curRowSize);
+  addingInfosets = false; 
+  nextInfosetPos = 0; 
+  added = 0; 
 
-    assert(row < rows);
-    assert(col < curRowSize); 
-    assert(pos < size); 
-    infoset.totalMoveProbs[m] = tablerows[row][col];
+  indexSize = fIndexSize; 
+  size = fSize; 
+  index = reinterpret_cast<IndexEntry *>(mapping + ISS_HEADER_CELLS*8); 
+  table = reinterpret_cast<double *>(mapping + (ISS_HEADER_CELLS + 2*indexSize)*8); 
 
-    next(row, col, pos, curRowSize); 
-  }
+  buildDirectIndex(); 
+  checkGrouped(); 
 
-  // now do the usual regret matching to get the curMoveProbs
+  return true;
+#endif
+}
 
-  double totPosReg = 0.0;
-  bool all_negative = true;
+void InfosetStore::dumpDeltaToDisk(std::string filename, unsigned long long since)
+{
+  StopWatch sw; 
 
-  for (int i = 0, m = firstmove; i < moves; i++, m++) 
+  // first pass to know how much there is
+  unsigned long long cells = 0, infosets = 0; 
+  for (unsigned long long i = 0; i < indexSize; i++)
   {
-    int movenum = m;
-    double cfr = infoset.cfr[movenum];
-    CHKDBL(cfr);
+    if (index[i].pos >= size) 
+      continue; 
 
-    if (cfr > 0.0)
+    const double * block = table + index[i].pos; 
+    if (blockLastUpdate(block) > since) 
     {
-      totPosReg = totPosReg + cfr;
-      all_negative = false;
+      cells += 1 + blockCells(blockActions(block)); 
+      infosets++; 
     }
   }
 
-  double probSum = 0.0;
+  double * buf = new double [ISS_HEADER_CELLS + cells]; 
+  unsigned long long header[ISS_HEADER_CELLS] = { ISS_DELTA_MAGIC, ISS_DELTA_VERSION, size, cells, infosets, since, 
+                                                  ourValues() }; 
+  memcpy(buf, header, sizeof(header)); 
 
-  for (int i = 0, m = firstmove; i < moves; i++, m++) 
+  double * p = buf + ISS_HEADER_CELLS; 
+  for (unsigned long long i = 0; i < indexSize; i++)
   {
-    int movenum = m;
-
-    if (!all_negative)
-    {
-      if (infoset.cfr[movenum] <= 0.0)
-      {
-        infoset.curMoveProbs[movenum] = 0.0;
-      }
-      else
-      {
-        assert(totPosReg >= 0.0);
-        if (totPosReg > 0.0)  // regret-matching
-          infoset.curMoveProbs[movenum] = infoset.cfr[movenum] / totPosReg;
+    if (index[i].pos >= size) 
+      continue; 
 
-      }
-    }
-    else
+    double * block = table + index[i].pos; 
+    if (blockLastUpdate(block) > since) 
     {
-      infoset.curMoveProbs[movenum] = 1.0/moves;
+      unsigned long long cellshere = blockCells(blockActions(block)); 
+      memcpy(p, &index[i].pos, 8); 
+      memcpy(p + 1, block, cellshere*8); 
+      p += 1 + cellshere; 
     }
+  }
 
-    CHKPROB(infoset.curMoveProbs[movenum]);
-    probSum += infoset.curMoveProbs[movenum];
+  string tmpname = filename + ".tmp"; 
+  unsigned long long bytes = (ISS_HEADER_CELLS + cells)*sizeof(double); 
+  int fd = openForWriting(tmpname); 
+  assert(fd >= 0); 
+  bool ok = bulkIO(fd, buf, bytes, 0, true); 
+  closeFile(fd); 
+  delete [] buf; 
+
+  if (!ok) 
+  {
+    cerr << "IS: error writing " << tmpname << endl; 
+    return; 
   }
 
-  return true;
+#if defined(_WIN32) || defined(_WIN64)
+  remove(filename.c_str()); 
+#endif
+  if (rename(tmpname.c_str(), filename.c_str()) != 0) 
+    cerr << "IS: could not rename " << tmpname << " to " << filename << endl; 
+
+  cout << "IS: delta of " << infosets << " infosets updated since iteration " << since << endl; 
+  reportIO("wrote", filename, bytes, sw.stop()); 
 }
 
-void InfosetStore::put_priv(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove)
+bool InfosetStore::isDeltaFile(std::string filename, unsigned long long & since)
 {
-  unsigned long long row, col, pos, curRowSize;
+  ifstream in(filename.c_str(), ios::in | ios::binary); 
+  if (!in.is_open())
+    return false; 
 
-  assert(moves > 0);
-  bool newinfoset = false; 
+  unsigned long long header[ISS_HEADER_CELLS]; 
+  in.read(reinterpret_cast<char *>(header), sizeof(header)); 
+  if (!in || header[0] != ISS_DELTA_MAGIC) 
+    return false; 
 
-  unsigned long long hashIndex = 0;
-  unsigned long long thepos = getPosFromIndex(infoset_key, hashIndex);  
-  if (addingInfosets && thepos >= size)
-  {
-    newinfoset = true; 
+  since = header[5]; 
+  return true; 
+}
 
-    // new infoset to be added at the end
-    assert(nextInfosetPos < size); 
+bool InfosetStore::applyDeltaFromDisk(std::string filename)
+{
+  StopWatch sw; 
 
-    // only add it if it's a new info set
-    pos = nextInfosetPos;
-    row = nextInfosetPos / rowsize;
-    col = nextInfosetPos % rowsize;
-    curRowSize = (row < (rows-1) ? rowsize : lastRowSize);
-    
-    //index[infoset_key] = pos;
-    assert(pos < size); 
-    indexKeys[hashIndex] = infoset_key;
-    indexVals[hashIndex] = pos;
+  int fd = openForReading(filename); 
+  if (fd < 0) 
+    return false; 
 
-    //cout << "Adding infosetkey: " << infoset_key << endl; 
+  unsigned long long header[ISS_HEADER_CELLS]; 
+  if (!bulkIO(fd, header, sizeof(header), 0, false) || header[0] != ISS_DELTA_MAGIC) 
+  {
+    closeFile(fd); 
+    return false; 
   }
-  else 
+
+  // a delta of values in another format applies to the file this store was converted from
+  unsigned long long valueFormat = valueFormatOf(header[6]); 
+  bool converting = (valueFormat != ourValues()); 
+  if (header[1] != ISS_DELTA_VERSION || header[2] != (converting ? convertedSize : size) 
+      || (converting && convertedPos.empty())) 
   {
-    // we've seen this one before, load it
-    newinfoset = false; 
+    cerr << "IS: " << filename << " is not a delta of these strategies" << endl; 
+    closeFile(fd); 
+    return false; 
+  }
 
-    //pos = index[infoset_key];
-    //pos = indexVals[hashIndex]; 
-    assert(thepos < size); 
-    pos = thepos; 
-    row = pos / rowsize;
-    col = pos % rowsize;
-    curRowSize = (row < (rows-1) ? rowsize : lastRowSize);
+  // the records have to fill the rest of the file exactly
+  unsigned long long cells = header[3]; 
+  if (cells > fileLength(fd) || fileLength(fd) != sizeof(header) + cells*sizeof(double)) 
+  {
+    cerr << "IS: the header of " << filename << " does not match its size" << endl; 
+    closeFile(fd); 
+    return false; 
   }
-  
-  // store the number of moves at this infoset
-  assert(row < rows);
-  assert(col < curRowSize); 
-  assert(pos < size); 
-  unsigned long long x = moves;
-  double y; 
-  assert(sizeof(x) == sizeof(double));
-  memcpy(&y, &x, sizeof(x));
-  tablerows[row][col] = y; 
-  next(row, col, pos, curRowSize);
-
-  // store the last update iter of this infoset
-  assert(row < rows);
-  assert(col < curRowSize); 
-  assert(pos < size); 
-  x = infoset.lastUpdate;
-  assert(sizeof(x) == sizeof(double));
-  memcpy(&y, &x, sizeof(x));
-  tablerows[row][col] = y; 
-  next(row, col, pos, curRowSize);
 
-  // moves are from 1 to moves, so write them in order. 
-  // first, regret, then avg. strat
-  for (int i = 0, m = firstmove; i < moves; i++, m++) 
-  { 
-    //cout << "pos = " << pos << ", row = " << row << endl;
-    if (row >= rows) {
-      cout << "iss stats: " << iss.getStats() << endl;
+  double * buf = new double [cells]; 
+  bool ok = bulkIO(fd, buf, cells*sizeof(double), sizeof(header), false); 
+  closeFile(fd); 
+
+  if (!ok) 
+  {
+    cerr << "IS: error reading " << filename << endl; 
+    delete [] buf; 
+    return false; 
+  }
+
+  // each record is checked before it is applied: a bad one stops there (the ones before it
+  // are in, so the store should not be used then)
+  unsigned long long hdrcells = headerCellsOf(valueFormat); 
+  for (unsigned long long c = 0; ok && c < cells; ) 
+  {
+    unsigned long long pos = 0; 
+    memcpy(&pos, buf + c, 8); 
+
+    unsigned long long actionshere = 0; 
+    if (c + 1 + hdrcells <= cells) 
+      actionshere = blockActions(buf + c + 1, hdrcells); 
+    if (actionshere < 1 || actionshere > BLUFFBID 
+        || c + 1 + fileBlockCells(actionshere, valueFormat) > cells) 
+    {
+      cerr << "IS: bad record at cell " << c << " of " << filename << endl; 
+      ok = false; 
+      break; 
     }
 
-    assert(row < rows);
-    assert(col < curRowSize); 
-    assert(pos < size); 
-    CHKDBL(infoset.cfr[m]); 
-    tablerows[row][col] = infoset.cfr[m];
+    unsigned long long dest = pos; 
+    if (converting) 
+    {
+      vector< pair<unsigned long long, unsigned long long> >::iterator it 
+        = lower_bound(convertedPos.begin(), convertedPos.end(), make_pair(pos, 0ULL)); 
+      if (it == convertedPos.end() || it->first != pos) 
+      {
+        cerr << "IS: record at cell " << c << " of " << filename << " is not an infoset" << endl; 
+        ok = false; 
+        break; 
+      }
+      dest = it->second; 
+    }
 
-    next(row, col, pos, curRowSize);
+    if (dest >= size || blockCells(actionshere) > size - dest) 
+    {
+      cerr << "IS: record at cell " << c << " of " << filename << " is outside the table" << endl; 
+      ok = false; 
+      break; 
+    }
 
-    assert(row < rows);
-    assert(col < curRowSize); 
-    assert(pos < size); 
-    tablerows[row][col] = infoset.totalMoveProbs[m];
+    if (converting) 
+      convertBlock(table + dest, buf + c + 1, valueFormat); 
+    else 
+      memcpy(table + dest, buf + c + 1, blockCells(actionshere)*8); 
 
-    next(row, col, pos, curRowSize); 
-    
+    c += 1 + fileBlockCells(actionshere, valueFormat); 
   }
 
-  if (newinfoset && addingInfosets)
-  {
-    nextInfosetPos = pos;
-    added++;
-  }
+  delete [] buf; 
+  invalidateStrategies(); 
+
+  if (!ok) 
+    return false; 
+
+  reportIO("applied", filename, sizeof(header) + cells*sizeof(double), sw.stop()); 
+  return true; 
 }
-  
-void InfosetStore::printValues()
+
+void InfosetStore::dumpCompressedToDisk(std::string filename, bool shuffle)
 {
-  for (unsigned int i = 0; i < indexSize; i++) 
-  {
-    if (indexVals[i] < size) 
-    {
-      // this is a valid position
-      unsigned long long row, col, pos, curRowSize;
-      pos = indexVals[i];
-      row = pos / rowsize;
-      col = pos % rowsize;
-      curRowSize = (row < (rows-1) ? rowsize : lastRowSize);
+  StopWatch sw; 
 
-      cout << "infosetkey = " << indexKeys[i]; 
-      cout << ", infosetkey_str = " << infosetkey_to_string(indexKeys[i]);
+  // the index, in key order
+  vector< pair<unsigned long long, unsigned long long> > entries; 
+  for (unsigned long long i = 0; i < indexSize; i++) 
+    if (index[i].pos < size) 
+      entries.push_back(make_pair(index[i].key, index[i].pos)); 
+  sort(entries.begin(), entries.end(), byKey); 
 
-      // read # actions
-      unsigned long long actionshere = 0;
-      assert(sizeof(actionshere) == sizeof(double)); 
-      memcpy(&actionshere, &tablerows[row][col], sizeof(actionshere)); 
-      next(row, col, pos, curRowSize);
-      
-      // read the integer
-      unsigned long long lastUpdate = 0;
-      double x = tablerows[row][col];
-      memcpy(&lastUpdate, &x, sizeof(actionshere)); 
-      next(row, col, pos, curRowSize);
+  vector<unsigned char> encoded; 
+  unsigned long long prevkey = 0, prevpos = 0; 
+  for (size_t e = 0; e < entries.size(); e++) 
+  {
+    // keys are increasing; positions are not, so their deltas are zigzag encoded
+    long long posdelta = static_cast<long long>(entries[e].second - prevpos); 
+    putVarint(encoded, entries[e].first - prevkey); 
+    putVarint(encoded, (static_cast<unsigned long long>(posdelta) << 1) ^ static_cast<unsigned long long>(posdelta >> 63)); 
+    prevkey = entries[e].first; 
+    prevpos = entries[e].second; 
+  }
 
-      cout << ", actions = " << actionshere << ", lastUpdate = " << lastUpdate << endl;
+  unsigned long long header[ISS_HEADER_CELLS] = { ISS_PACK_MAGIC, ISS_PACK_VERSION, indexSize, size, 
+                                                  entries.size(), (shuffle ? ISS_PACK_SHUFFLE : 0ULL), 
+                                                  encoded.size(), ourValues() }; 
 
-      for (unsigned long long a = 0; a < actionshere; a++) 
-      {
-        // cfr
-        assert(row < rows);
-        assert(col < curRowSize); 
-        cout << "  cfr[" << a << "]=" << tablerows[row][col]; 
-      
-        next(row, col, pos, curRowSize);
-        // total move probs
-        cout << "  tmp[" << a << "]=" << tablerows[row][col]; 
-        cout << endl;
+  string tmpname = filename + ".tmp"; 
+  PackWriter pw(tmpname, header, sizeof(header)); 
 
-        next(row, col, pos, curRowSize);
-        // next cfr
-      }
+  for (size_t done = 0; done < encoded.size(); done += PACK_BUFFER) 
+    pw.write(&encoded[done], static_cast<unsigned int>(MIN(encoded.size() - done, PACK_BUFFER))); 
 
-      cout << endl;
+  unsigned char * block = new unsigned char [PACK_BLOCK_CELLS*8]; 
+  for (unsigned long long pos = 0; pos < size; pos += PACK_BLOCK_CELLS) 
+  {
+    unsigned long long cells = MIN(size - pos, PACK_BLOCK_CELLS); 
+    if (shuffle) 
+    {
+      shuffleBytes(reinterpret_cast<unsigned char *>(table + pos), block, cells); 
+      pw.write(block, static_cast<unsigned int>(cells*8)); 
     }
+    else 
+      pw.write(table + pos, static_cast<unsigned int>(cells*8)); 
   }
-}
+  delete [] block; 
 
-void InfosetStore::clear()
-{
-  for (unsigned int i = 0; i < indexSize; i++) 
+  if (!pw.finish()) 
   {
-    if (indexVals[i] < size) 
-    {
-      // this is a valid position
-      unsigned long long row, col, pos, curRowSize;
-      pos = indexVals[i];
-      row = pos / rowsize;
-      col = pos % rowsize;
-      curRowSize = (row < (rows-1) ? rowsize : lastRowSize);
+    cerr << "IS: error writing " << tmpname << endl; 
+    return; 
+  }
 
-      // read # actions
-      unsigned long long actionshere = 0;
-      assert(sizeof(actionshere) == sizeof(double)); 
-      memcpy(&actionshere, &tablerows[row][col], sizeof(actionshere)); 
-      next(row, col, pos, curRowSize);
-      
-      // read the integer
-      unsigned long long lastUpdate = 0;
-      double x = tablerows[row][col];
-      memcpy(&lastUpdate, &x, sizeof(actionshere)); 
-      tablerows[row][col] = 0.0;
-      next(row, col, pos, curRowSize);
+#if defined(_WIN32) || defined(_WIN64)
+  remove(filename.c_str()); 
+#endif
+  if (rename(tmpname.c_str(), filename.c_str()) != 0) 
+    cerr << "IS: could not rename " << tmpname << " to " << filename << endl; 
 
-      for (unsigned long long a = 0; a < actionshere; a++) 
-      {
-        // cfr
-        assert(row < rows);
-        assert(col < curRowSize); 
+  unsigned long long raw = (ISS_HEADER_CELLS + 2*indexSize + size)*8; 
+  cout << "IS: compressed to " << (100.0 * pw.written / raw) << "% of the uncompressed file" << endl; 
+  reportIO("wrote", filename, pw.written, sw.stop()); 
+}
 
-        tablerows[row][col] = 0.0;
-      
-        next(row, col, pos, curRowSize);
-        // total move probs
-        
-        tablerows[row][col] = 0.0;
+bool InfosetStore::readCompressedFromDisk(std::string filename)
+{
+  StopWatch sw; 
 
-        next(row, col, pos, curRowSize);
-        // next cfr
-      }
-    }
+  unsigned long long header[ISS_HEADER_CELLS]; 
+  PackReader pr(filename, header, sizeof(header)); 
+
+  if (!pr.ok) 
+  {
+    cerr << "IS: could not read the header of " << filename << endl; 
+    return false; 
   }
-}
 
-void InfosetStore::computeBound(double & sum_RTimm1, double & sum_RTimm2)
-{
-  for (unsigned int i = 0; i < indexSize; i++) 
+  if (header[0] != ISS_PACK_MAGIC || header[1] != ISS_PACK_VERSION) 
   {
-    if (indexVals[i] < size) 
-    {
-      // which player is it?
-      unsigned long long key = indexKeys[i]; 
-      double & b = (key % 2 == 0 ? sum_RTimm1 : sum_RTimm2); 
+    cerr << "IS: " << filename << " is not a compressed strategies file" << endl; 
+    return false; 
+  }
 
-      // this is a valid position
-      unsigned long long row, col, pos, curRowSize;
-      pos = indexVals[i];
-      row = pos / rowsize;
-      col = pos % rowsize;
-      curRowSize = (row < (rows-1) ? rowsize : lastRowSize);
+  unsigned long long indexsize = header[2]; 
+  unsigned long long tablesize = header[3]; 
+  unsigned long long infosets = header[4]; 
+  unsigned long long encodedBytes = header[6]; 
+  bool shuffled = ((header[5] & ISS_PACK_SHUFFLE) != 0); 
+
+  // what the header says is there has to fit in the rest of the file, inflated: the table 
+  // bounds the rest, as blocks are at least 2 cells and index entries at least 2 bytes
+  unsigned long long maxInflated = MAX_INFLATE_RATIO*(pr.fileBytes - sizeof(header)); 
+  if (pr.fileBytes < sizeof(header) || tablesize > maxInflated/8 || encodedBytes > maxInflated 
+      || indexsize == 0 || (indexsize & (indexsize - 1)) != 0 
+      || indexsize > MAX(2*tablesize, DEFAULT_INDEX_SIZE) 
+      || infosets > indexsize || infosets > tablesize/2 || 2*infosets > encodedBytes) 
+  {
+    cerr << "IS: the header of " << filename << " does not match its size" << endl; 
+    return false; 
+  }
 
-      // read # actions
-      unsigned long long actionshere = 0;
-      assert(sizeof(actionshere) == sizeof(double)); 
-      memcpy(&actionshere, &tablerows[row][col], sizeof(actionshere)); 
-      next(row, col, pos, curRowSize);
-      
-      // read the integer
-      unsigned long long lastUpdate = 0;
-      double x = tablerows[row][col];
-      memcpy(&lastUpdate, &x, sizeof(actionshere)); 
-      next(row, col, pos, curRowSize);
+  // the index, decoded before the store is replaced, so that a bad file leaves it as it was
+  vector<unsigned char> encoded(encodedBytes + 1); 
+  bool ok = true; 
+  for (size_t done = 0; ok && done < encodedBytes; done += PACK_BUFFER) 
+    ok = pr.read(&encoded[done], static_cast<unsigned int>(MIN(encodedBytes - done, PACK_BUFFER))); 
+
+  // the last byte stays 0, so a varint never runs past it
+  vector< pair<unsigned long long, unsigned long long> > entries; 
+  entries.reserve(ok ? infosets : 0); 
+  const unsigned char * p = &encoded[0]; 
+  const unsigned char * end = p + encodedBytes; 
+  unsigned long long key = 0, pos = 0; 
+  for (unsigned long long e = 0; ok && e < infosets; e++) 
+  {
+    if (p >= end) 
+      break; 
+    key += getVarint(p); 
+
+    if (p >= end) 
+      break; 
+    unsigned long long zz = getVarint(p); 
+    pos += (zz >> 1) ^ (~(zz & 1) + 1); 
+
+    if (pos >= tablesize) 
+      break; 
+    entries.push_back(make_pair(key, pos)); 
+  }
 
-      double max = NEGINF;
-      for (unsigned long long a = 0; a < actionshere; a++) 
-      {
-        // cfr
-        assert(row < rows);
-        assert(col < curRowSize); 
+  if (!ok || entries.size() != infosets) 
+  {
+    cerr << "IS: error reading the index of " << filename << endl; 
+    return false; 
+  }
 
-        double cfr = tablerows[row][col]; 
-        CHKDBL(cfr);
-        if (cfr > max)
-          max = cfr; 
-      
-        next(row, col, pos, curRowSize);
-        // total move probs
-        next(row, col, pos, curRowSize);
-        // next cfr
-      }
+  destroy(); 
 
-      assert(max > NEGINF);
+  addingInfosets = false; 
+  nextInfosetPos = 0; 
+  added = 0; 
+  size = tablesize; 
 
-      double delta = max; 
-      delta = MAX(0.0, delta); 
+  allocIndex(indexsize); 
+  for (size_t e = 0; e < entries.size(); e++) 
+    addToIndex(entries[e].first, entries[e].second); 
 
-      b += delta; 
+  // the table
+  table = allocTable(size, allocation); 
+  unsigned char * block = new unsigned char [PACK_BLOCK_CELLS*8]; 
+  for (unsigned long long c = 0; ok && c < size; c += PACK_BLOCK_CELLS) 
+  {
+    unsigned long long cells = MIN(size - c, PACK_BLOCK_CELLS); 
+    if (shuffled) 
+    {
+      ok = pr.read(block, static_cast<unsigned int>(cells*8)); 
+      unshuffleBytes(block, reinterpret_cast<unsigned char *>(table + c), cells); 
     }
+    else 
+      ok = pr.read(table + c, static_cast<unsigned int>(cells*8)); 
   }
+  delete [] block; 
 
-  sum_RTimm1 /= static_cast<double>(iter); 
-  sum_RTimm2 /= static_cast<double>(iter); 
-}
+  if (!ok) 
+  {
+    cerr << "IS: error reading " << filename << endl; 
+    return false; 
+  }
 
+  if (valueFormatOf(header[7]) != ourValues()) 
+    convertValues(valueFormatOf(header[7])); 
 
+  buildDirectIndex(); 
+  checkGrouped(); 
 
-void InfosetStore::writeBytes(std::ofstream & out, void * addr, unsigned int num)
-{
-  out.write(reinterpret_cast<const char *>(addr), num); 
+  // throughput of what was decompressed
+  reportIO("decompressed", filename, (ISS_HEADER_CELLS + 2*indexSize + size)*8, sw.stop()); 
+  return true; 
 }
 
-void InfosetStore::readBytes(std::ifstream & in, void * addr, unsigned int num)  
+void InfosetStore::syncToDisk()
 {
-  in.read(reinterpret_cast<char *>(addr), num); 
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (mapping != NULL && mappingShared) 
+    msync(mapping, mappingBytes, MS_SYNC); 
+#endif
 }
 
-void InfosetStore::dumpToDisk(std::string filename) 
+void InfosetStore::copy(InfosetStore & dest)
 {
-  ofstream out(filename.c_str(), ios::out | ios::binary); 
-  assert(out.is_open()); 
-
-  assert(sizeof(unsigned long long) == 8); 
-  assert(sizeof(double) == 8);
-
-  // some integers
-  writeBytes(out, &indexSize, 8);
-  writeBytes(out, &size, 8);
-  writeBytes(out, &rowsize, 8);
-  writeBytes(out, &rows, 8);
-  writeBytes(out, &lastRowSize, 8);
-
-  // the index
-  for (unsigned long long i = 0; i < indexSize; i++)
+  // keep the destination's memory if it has the same shape (e.g. repeated snapshots)
+  if (dest.table == NULL || dest.mapping != NULL || dest.size != size || dest.indexSize != indexSize)
   {
-    writeBytes(out, indexKeys + i, 8); 
-    writeBytes(out, indexVals + i, 8); 
-  }
+    dest.destroy();
 
-  // the table
-  unsigned long long pos = 0, row = 0, col = 0, curRowSize = rowsize; 
-  while (pos < size) 
-  {
-    writeBytes(out, tablerows[row] + col, 8);  
-    next(row, col, pos, curRowSize); 
-  }
+    dest.indexSize = indexSize;
+    dest.size = size;
 
-  out.close();
-}
+    dest.index = new IndexEntry [indexSize];
+    dest.table = allocTable(size, dest.allocation); 
+  }
 
-void InfosetStore::copy(InfosetStore & dest)
-{
-  dest.destroy();
+  memcpy(dest.index, index, indexSize*sizeof(IndexEntry)); 
+  memcpy(dest.table, table, size*sizeof(double)); 
 
-  dest.indexSize = indexSize;
-  dest.size = size;
-  dest.rowsize = rowsize;
-  dest.rows = rows;
-  dest.lastRowSize = lastRowSize;
+  dest.addingInfosets = false; 
 
-  dest.indexKeys = new unsigned long long [indexSize];
-  dest.indexVals = new unsigned long long [indexSize];
-  for (unsigned long long i = 0; i < indexSize; i++)
-  {
-    dest.indexKeys[i] = indexKeys[i];
-    dest.indexVals[i] = indexVals[i];
-  }
+  if (dest.directIndex != NULL) 
+    delete [] dest.directIndex; 
+  dest.directIndex = NULL; 
+  dest.directSize = 0; 
 
-  dest.tablerows = new double* [rows];
-  assert(dest.tablerows != NULL);
-  for (unsigned long long i = 0; i < rows; i++) 
-  {
-    if (i != (rows-1))
-    {
-      dest.tablerows[i] = new double[rowsize];
-      assert(dest.tablerows[i] != NULL);
-    }
-    else 
-    {
-      dest.tablerows[i] = new double[lastRowSize];
-      assert(dest.tablerows[i] != NULL);
-    }
-  }
+  dest.grouped = grouped; 
 
-  unsigned long long pos = 0, row = 0, col = 0, curRowSize = rowsize; 
-  while (pos < size) 
+  if (directIndex != NULL) 
   {
-    dest.tablerows[row][col] = tablerows[row][col];
-    next(row, col, pos, curRowSize); 
+    dest.directSize = directSize; 
+    dest.directIndex = new unsigned long long [directSize]; 
+    memcpy(dest.directIndex, directIndex, directSize*sizeof(unsigned long long)); 
   }
 }
 
@@ -612,125 +2089,200 @@ bool InfosetStore::readFromDisk(std::string filename)
   nextInfosetPos = 0; 
   added = 0; 
 
+  StopWatch sw; 
+
   ifstream in(filename.c_str(), ios::in | ios::binary); 
   //assert(in.is_open());  
   if (!in.is_open())
     return false; 
 
+  unsigned long long magic = 0; 
+  readBytes(in, &magic, 8); 
+  if (magic == ISS_PACK_MAGIC) 
+    return readCompressedFromDisk(filename); 
+  in.seekg(0); 
+
+  destroy(); 
+
   // some integers
-  readBytes(in, &indexSize, 8);        
-  readBytes(in, &size, 8);        
-  readBytes(in, &rowsize, 8);        
-  readBytes(in, &rows, 8);        
-  readBytes(in, &lastRowSize, 8);        
+  bool legacy = false; 
+  unsigned long long oIndexSize = 0, valueFormat = 0; 
+  unsigned long long offset = readHeader(in, oIndexSize, size, legacy, valueFormat)*8; 
+  in.close();
+
+  int fd = openForReading(filename); 
+  if (fd < 0) 
+    return false; 
  
-  // the index
-  indexKeys = new unsigned long long [indexSize]; 
-  indexVals = new unsigned long long [indexSize]; 
-  for (unsigned long long i = 0; i < indexSize; i++)
+  // the index. in the current format it is used as is; entries of older files are 
+  // re-inserted, since they were placed with a different hash function (key % indexSize)
+  allocIndex(oIndexSize); 
+  bool ok = true; 
+  if (offset == ISS_HEADER_CELLS*8 && indexSize == oIndexSize) 
+  {
+    ok = bulkIO(fd, index, indexSize*sizeof(IndexEntry), offset, false); 
+  }
+  else 
   {
-    readBytes(in, indexKeys + i, 8); 
-    readBytes(in, indexVals + i, 8); 
+    IndexEntry * entries = new IndexEntry [oIndexSize]; 
+    ok = bulkIO(fd, entries, oIndexSize*sizeof(IndexEntry), offset, false); 
+    for (unsigned long long i = 0; ok && i < oIndexSize; i++)
+      if (entries[i].pos < size) 
+        addToIndex(entries[i].key, entries[i].pos); 
+    delete [] entries; 
   }
+  offset += oIndexSize*sizeof(IndexEntry); 
+
+  // the table 
+  table = allocTable(size, allocation); 
+  ok = ok && bulkIO(fd, table, size*sizeof(double), offset, false); 
+  offset += size*sizeof(double); 
 
-  // table rows (allocation)
-  tablerows = new double* [rows];
-  assert(tablerows != NULL);
-  for (unsigned long long i = 0; i < rows; i++) 
+  closeFile(fd); 
+
+  if (!ok) 
   {
-    if (i != (rows-1))
-    {
-      tablerows[i] = new double[rowsize];
-      assert(tablerows[i] != NULL);
-      for (unsigned long long j = 0; j < rowsize; j++)
-        tablerows[i][j] = 0.0;
-    }
-    else 
-    {
-      tablerows[i] = new double[lastRowSize];
-      assert(tablerows[i] != NULL);
-      for (unsigned int j = 0; j < lastRowSize; j++)
-        tablerows[i][j] = 0.0;
-    }
+    cerr << "IS: error reading " << filename << endl; 
+    return false; 
   }
 
-  // tablerows (read from disk)
-  unsigned long long pos = 0, row = 0, col = 0, curRowSize = rowsize; 
-  while (pos < size) 
+  reportIO("read", filename, offset, sw.stop()); 
+
+  if (legacy) 
   {
-    readBytes(in, tablerows[row] + col, 8);  
-    next(row, col, pos, curRowSize); 
+    for (unsigned long long i = 0; i < indexSize; i++)
+    {
+      if (index[i].pos < size) 
+      {
+        unsigned long long actionshere = 0; 
+        memcpy(&actionshere, table + index[i].pos, sizeof(actionshere)); 
+        assert(actionshere <= BLUFFBID); 
+        deinterleave(table + index[i].pos, static_cast<int>(actionshere)); 
+      }
+    }
   }
 
-  in.close();
+  if (valueFormat != ourValues()) 
+    convertValues(valueFormat); 
+
+  buildDirectIndex(); 
+  checkGrouped(); 
 
   return true;
 }
 
 // replace one of the players strategies with one loaded from a 
 // different file
+//
+// In one pass: the file's index is read at once, the player's blocks are sorted by their 
+// position in the file and the table is then streamed through, IO_CHUNK bytes at a time. 
 void InfosetStore::importValues(int player, string filename)
 {
+  StopWatch sw; 
+
   ifstream in(filename.c_str(), ios::in | ios::binary);
 
-  unsigned long long oIndexSize = 0, osize = 0, orowsize = 0, orows = 0, olastRowSize = 0;
-  
-  readBytes(in, &oIndexSize, 8);        
-  readBytes(in, &osize, 8);        
-  readBytes(in, &orowsize, 8);        
-  readBytes(in, &orows, 8);        
-  readBytes(in, &olastRowSize, 8);        
+  unsigned long long magic = 0; 
+  readBytes(in, &magic, 8); 
+  in.seekg(0); 
 
-  assert(oIndexSize == indexSize);
-  assert(osize == size);
-  assert(orowsize == rowsize);
-  assert(orows == rows);
-  assert(olastRowSize == lastRowSize);
+  // compressed files cannot be read in place: unpack the whole file first
+  if (magic == ISS_PACK_MAGIC) 
+  {
+    in.close(); 
+    InfosetStore other; 
+    other.readCompressedFromDisk(filename); 
 
-  unsigned long long maskresult = player - 1; 
+    for (unsigned long long i = 0; i < other.indexSize; i++) 
+    {
+      if (other.index[i].pos >= other.size || (other.index[i].key & 1ULL) != static_cast<unsigned long long>(player - 1)) 
+        continue; 
 
-  for (unsigned int i = 0; i < oIndexSize; i++)
-  {
-    Infoset is;
+      unsigned long long actionshere = blockActions(other.table + other.index[i].pos); 
 
-    // next index element
-    streampos sp = (5 + i*2); sp = sp*8;
-    in.seekg(sp);
+      unsigned long long pos = getPosFromIndex(other.index[i].key); 
+      assert(pos + blockCells(actionshere) <= size); 
+      memcpy(table + pos, other.table + other.index[i].pos, blockCells(actionshere)*8); 
+    }
 
-    unsigned long long key = 0, val = 0;
-    readBytes(in, &key, 8);
-    readBytes(in, &val, 8);
+    invalidateStrategies(); 
+    return; 
+  }
 
-    if ((key & 1ULL) == maskresult && val < size)
-    {
-      streampos fp = 5;
-      fp += oIndexSize*2;
-      fp += val;
-      fp = fp*8;
+  unsigned long long oIndexSize = 0, osize = 0, valueFormat = 0;
+  bool legacy = false; 
+  unsigned long long offset = readHeader(in, oIndexSize, osize, legacy, valueFormat)*8; 
+  in.close(); 
 
-      in.seekg(fp);
+  int fd = openForReading(filename); 
+  if (fd < 0) 
+  {
+    cerr << "IS: could not open " << filename << endl; 
+    return; 
+  }
 
-      unsigned long long actionshere = 0;
-      unsigned long long lastUpdate = 0;
-      
-      readBytes(in, &actionshere, 8);
-      readBytes(in, &lastUpdate, 8);
+  // the player's infosets: where they are in the file, and their keys
+  IndexEntry * entries = new IndexEntry [oIndexSize]; 
+  bool ok = bulkIO(fd, entries, oIndexSize*sizeof(IndexEntry), offset, false); 
+  offset += oIndexSize*sizeof(IndexEntry); 
+
+  vector< pair<unsigned long long, unsigned long long> > blocks; 
+  for (unsigned long long i = 0; ok && i < oIndexSize; i++) 
+    if (entries[i].pos < osize && (entries[i].key & 1ULL) == static_cast<unsigned long long>(player - 1)) 
+      blocks.push_back(make_pair(entries[i].pos, entries[i].key)); 
+  delete [] entries; 
+  sort(blocks.begin(), blocks.end()); 
+
+  // each chunk starts at the first block not done yet
+  unsigned long long chunkSize = IO_CHUNK/sizeof(double); 
+  double * chunk = new double [chunkSize]; 
+  unsigned long long bytes = 0; 
+  for (size_t b = 0; ok && b < blocks.size(); ) 
+  {
+    unsigned long long chunkStart = blocks[b].first; 
+    unsigned long long chunkCells = MIN(chunkSize, osize - chunkStart); 
+    ok = bulkIO(fd, chunk, chunkCells*sizeof(double), offset + chunkStart*sizeof(double), false); 
+    bytes += chunkCells*sizeof(double); 
 
-      is.actionshere = static_cast<int>(actionshere);
-      is.lastUpdate = lastUpdate;
+    size_t first = b; 
+    for (; ok && b < blocks.size(); b++) 
+    {
+      double * src = chunk + (blocks[b].first - chunkStart); 
+      if (blocks[b].first - chunkStart + headerCellsOf(valueFormat) > chunkCells) 
+        break; 
+
+      unsigned long long actionshere = blockActions(src, headerCellsOf(valueFormat)); 
+      assert(actionshere <= BLUFFBID); 
+      unsigned long long cells = fileBlockCells(actionshere, valueFormat); 
+      if (blocks[b].first - chunkStart + cells > chunkCells) 
+        break; 
+
+      // older files have the regrets and average strategy interleaved
+      if (legacy) 
+        deinterleave(src, static_cast<int>(actionshere)); 
+
+      unsigned long long pos = getPosFromIndex(blocks[b].second); 
+      assert(pos + blockCells(actionshere) <= size); 
+      if (valueFormat == ourValues()) 
+        memcpy(table + pos, src, cells*sizeof(double)); 
+      else 
+        convertBlock(table + pos, src, valueFormat); 
+    }
 
-      assert(actionshere <= BLUFFBID);
+    // a block running past the end of the table
+    ok = ok && (b > first); 
+  }
 
-      for (unsigned long long a = 0; a < actionshere; a++)
-      {
-        double * cfrptr = is.cfr;
-        double * tmpptr = is.totalMoveProbs;
-        readBytes(in, cfrptr + a, 8);
-        readBytes(in, tmpptr + a, 8);
-      }
+  delete [] chunk; 
+  closeFile(fd); 
+  invalidateStrategies(); 
 
-      put(key, is, static_cast<int>(actionshere), 0); 
-    }
+  if (!ok) 
+  {
+    cerr << "IS: error reading " << filename << endl; 
+    return; 
   }
+
+  reportIO("imported", filename, offset + bytes, sw.stop()); 
 }
   
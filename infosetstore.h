@@ -6,39 +6,155 @@
 #define __INFOSETSTORE_H__
 
 #include <string>
+#include <cstring>
+#include <vector>
+#include <utility>
 #include <fstream>
 
+// Regrets and average strategy sums are kept as doubles, or as floats when compiled with 
+// -DISS_FLOAT (half the memory; storecmp shows what the rounding costs in exploitability).
+// Compiled with -DISS_INT (purecfr), regrets are 32-bit integers and the average strategy 
+// is 32-bit counts of the sampled actions: Pure CFR only ever adds integers to them.
+#if defined(ISS_INT)
+typedef int RegretValue; 
+typedef unsigned int AvgValue; 
+#elif defined(ISS_FLOAT)
+typedef float RegretValue; 
+typedef float AvgValue; 
+#else
+typedef double RegretValue; 
+typedef double AvgValue; 
+#endif
+
+// Each infoset's block starts with its # of actions and last update: two 8-byte cells, or 
+// one when compiled with -DISS_PACKED (the # of actions in the low byte, the last update in 
+// the rest). Neither changes after the infoset is added but the last update, so with Bluff's 
+// 1 to 13 actions the first cell is mostly empty. purecfr is built packed.
+#ifdef ISS_PACKED
+#define BLOCK_HEADER_CELLS 1ULL
+#else
+#define BLOCK_HEADER_CELLS 2ULL
+#endif
+
+// # of 8-byte cells an infoset with this many actions takes in the table
+inline unsigned long long blockCells(unsigned long long actions) 
+{ 
+  return BLOCK_HEADER_CELLS + (actions*(sizeof(RegretValue) + sizeof(AvgValue)) + 7)/8; 
+}
+
+// The header of a block with headerCells cells (files may have the other layout)
+inline unsigned long long blockActions(const double * block, unsigned long long headerCells = BLOCK_HEADER_CELLS)
+{
+  unsigned long long x; 
+  memcpy(&x, block, sizeof(x)); 
+  return (headerCells == 1 ? (x & 0xFF) : x); 
+}
+
+inline unsigned long long blockLastUpdate(const double * block, unsigned long long headerCells = BLOCK_HEADER_CELLS)
+{
+  unsigned long long x; 
+  memcpy(&x, block + headerCells - 1, sizeof(x)); 
+  return (headerCells == 1 ? (x >> 8) : x); 
+}
+
+inline void setBlockHeader(double * block, unsigned long long actions, unsigned long long lastUpdate)
+{
+#ifdef ISS_PACKED
+  unsigned long long x = (lastUpdate << 8) | actions; 
+  memcpy(block, &x, sizeof(x)); 
+#else
+  memcpy(block, &actions, sizeof(actions)); 
+  memcpy(block + 1, &lastUpdate, sizeof(lastUpdate)); 
+#endif
+}
+
+inline void setBlockLastUpdate(double * block, unsigned long long lastUpdate)
+{
+#ifdef ISS_PACKED
+  setBlockHeader(block, blockActions(block), lastUpdate); 
+#else
+  memcpy(block + 1, &lastUpdate, sizeof(lastUpdate)); 
+#endif
+}
+
+// How the table's memory is allocated (see InfosetStore::setAllocation), ORed together.
+// By default its pages are regular ones, placed on the NUMA node of the thread that first 
+// writes them.
+#define ISS_ALLOC_THP        1   // transparent huge pages (madvise)
+#define ISS_ALLOC_HUGETLB    2   // from the reserved huge page pool (MAP_HUGETLB), if it has enough
+#define ISS_ALLOC_INTERLEAVE 4   // pages spread over the NUMA nodes in turn
+
 #include "bluff.h"
 
 struct Infoset; 
+struct InfosetView;
 
 class InfosetStore
 {
   // stores the position of each infoset in the large table
-  // unlike in bluffpt, this is a hash table that uses linear probing
-  unsigned long long * indexKeys; 
-  unsigned long long * indexVals; 
-  unsigned long long indexSize;
+  // unlike in bluffpt, this is a hash table: open addressing with Robin Hood probing 
+  // (entries sit in order of their distance from their home slot, so a lookup for a
+  // missing key stops early). The key and position are stored side by side.
+  struct IndexEntry
+  {
+    unsigned long long key; 
+    unsigned long long pos;   // IS_EMPTY_SLOT if unused
+  };
+
+  IndexEntry * index; 
+  unsigned long long indexSize;   // always a power of 2
  
-  // returns the position into the large table or indexSize if not found
-  // hashIndex is set to the index of the hash table where this key would go
-  unsigned long long getPosFromIndex(unsigned long long infoset_key, unsigned long long & hashIndex); 
-  // use this one if you don't care about the hashIndex
+  // While infosets are added the index doubles when it gets too full. The entries of the
+  // previous index are moved over a few at a time on each insert (lookups check both until
+  // it is empty), so no single put pays for rehashing the whole index.
+  IndexEntry * oldIndex; 
+  unsigned long long oldIndexSize; 
+  unsigned long long migrated;    // slots of oldIndex already moved
+
+  void allocIndex(unsigned long long minsize); 
+  void growIndex(); 
+  void migrateIndex(unsigned long long slots); 
+  unsigned long long homeSlot(unsigned long long infoset_key); 
+
+  // returns the position into the large table or size if not found
   unsigned long long getPosFromIndex(unsigned long long infoset_key);
+  static unsigned long long findInIndex(const IndexEntry * idx, unsigned long long idxsize, unsigned long long infoset_key, 
+                                        bool count = true); 
+  void addToIndex(unsigned long long infoset_key, unsigned long long pos); 
+
+  // When the infoset keys are small enough (e.g. below 2^17 in Bluff(1,1)), positions are 
+  // also stored in a table indexed directly by the key, so that a lookup is a single memory
+  // access instead of hashing and probing. Built once no more infosets are being added.
+  unsigned long long * directIndex; 
+  unsigned long long directSize;
+  void buildDirectIndex(); 
+
+  // Are the infosets of each player at each bid sequence (one per chance outcome) laid out 
+  // one after the other, in order of the outcome? Then getAll needs a single lookup. 
+  // initInfosets adds them that way; checked whenever the index is built.
+  bool grouped; 
+  void checkGrouped(); 
 
-  // To avoid large contiguous portions of memory, store as rows of bitsets
-  double ** tablerows;
+  // lays the table out again for our RegretValue and AvgValue, when it was read from a file 
+  // with values in another format. The old positions are kept (with the size of the table they
+  // were in) so that deltas taken from that file can still be applied.
+  void convertValues(unsigned long long fileFormat); 
+  std::vector< std::pair<unsigned long long, unsigned long long> > convertedPos;   // old, new
+  unsigned long long convertedSize; 
 
-  // total items to be stored
-  // size in bytes of each
-  // # bytes per row
-  // # rows
+  // The large table: one contiguous (page-aligned) block, so each infoset's data 
+  // can be reached from a single pointer. Grows while infosets are added (which moves
+  // it, so views must not be held across a put of a new infoset)
+  double * table;
+
+  // total items to be stored (while adding, the capacity of the table)
   unsigned long long size; 
-  unsigned long long rowsize;
-  unsigned long long rows;
 
-  // last row is the leftover (smaller)
-  unsigned long long lastRowSize;
+  // when the store was mapped from a file, the index and table point into this mapping
+  char * mapping; 
+  size_t mappingBytes; 
+  bool mappingShared; 
+  std::string mappedFile; 
 
   // are we added infosets to this store? when doing so, we update the infoset counter
   // and add info to the index. when not doing so, we assume the index will get us our
@@ -47,33 +163,44 @@ class InfosetStore
   unsigned long long nextInfosetPos;
   unsigned long long added;
 
-  bool get_priv(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove); 
-  void put_priv(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove); 
+  // The current strategies computed by getView, kept until the regrets change (off unless 
+  // cacheStrategies is called). Parallel to the table: at an infoset's position, 1 if its
+  // strategy is there, in the cells after it.
+  double * strategyCache; 
+  void matchView(InfosetView & view, unsigned long long pos, bool match); 
+  void invalidateStrategies(); 
 
-  void next(unsigned long long & row, unsigned long long & col, unsigned long long & pos, unsigned long long & curRowSize); 
+  bool locking;   // see setLocking
+  bool prefetching;   // see prefetch
+  void prefetchSlot(unsigned long long infoset_key); 
+  void prefetchBlocks(unsigned long long infoset_key, unsigned long long cells); 
+  void prefetchGroup(unsigned long long bidseq, int player, int moves); 
+  unsigned int allocation;   // see setAllocation
+
+  bool get_priv(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove, bool match); 
+  void put_priv(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove); 
 
 public:
 
   InfosetStore()
   {
-    tablerows = NULL;
+    index = NULL;
+    oldIndex = NULL;
+    table = NULL;
+    mapping = NULL;
+    mappingBytes = 0;
+    mappingShared = false;
+    directIndex = NULL;
+    directSize = 0;
+    grouped = false;
+    strategyCache = NULL;
+    locking = false;
+    prefetching = false;
+    allocation = 0;
+    convertedSize = 0;
   }
 
-  void destroy()
-  {
-    if (tablerows != NULL)
-    {
-      delete [] indexKeys; 
-      delete [] indexVals;
-
-      for (unsigned int i = 0; i < rows; i++) 
-        delete [] tablerows[i];
-    
-      delete [] tablerows;
-    }
-
-    tablerows = NULL;
-  }
+  void destroy(); 
 
   ~InfosetStore()
   {
@@ -82,31 +209,104 @@ public:
   
   unsigned long long getSize() { return size; }
 
-  // First param: total # of doubles needed. 
-  //   Should be the total # of (infoset,action) pairs times 2 (2 doubles each)
-  // Second param: size of index. 
-  //   Should be the max number taken by an infoset key represented as an integer + 1
+  // First param: initial # of 8-byte cells. 
+  //   The sum of blockCells over the infosets, if known
+  // Second param: initial size of index. 
+  //   Larger than the number of infosets, if known (rounded up to a power of 2)
+  // Both grow as needed while adding infosets; 0 starts from small defaults
   void init(unsigned long long _size, unsigned long long _indexsize);
+
+  // ISS_ALLOC_* flags for the tables allocated from now on (by init and the file readers; 
+  // mapped files are used as they are). With sampling algorithms on a big game, most 
+  // accesses miss the TLB; huge pages cover 512 times more of the table per entry.
+  void setAllocation(unsigned int _allocation); 
   std::string getStats();
 
-  void stopAdding() { addingInfosets = false; } 
+  // trims the table to what was used and sets up the index for lookups only
+  void stopAdding(); 
   unsigned long long getNextPos() { return nextInfosetPos; }
   unsigned long long getAdded() { return added; }
 
-  bool get(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove); 
+  // Without match, curMoveProbs is not computed (e.g. only the average strategy is needed)
+  bool get(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove, bool match = true); 
   void put(unsigned long long infoset_key, Infoset & infoset, int moves, int firstmove); 
 
+  // zero-copy access: the view points straight into the table, so the solvers
+  // update regrets and average strategy in place (no put needed). Without match,
+  // curMoveProbs is left alone (for solvers that sample from the regrets themselves).
+  bool getView(unsigned long long infoset_key, InfosetView & view, int moves, bool match = true);
+
+  // Keep the strategies getView computes, so that getting an infoset again before its regrets
+  // change copies them instead (in vanilla CFR, the opponent's infosets are visited once per
+  // chance outcome with the same regrets). Takes as much memory again as the table. Solvers
+  // using it must call InfosetView::regretsUpdated when they change the regrets.
+  void cacheStrategies(); 
+
+  // Several threads can get and update infosets at once once no more are being added (after
+  // stopAdding, or loading): lookups only read the index, and each thread counts its own 
+  // lookups for getStats. Infosets are added by one thread.
+  //
+  // Updates to the same infoset by different threads are not synchronized by default 
+  // (Hogwild: a racing update may be lost, which the averaging tolerates, and nothing waits).
+  // With setLocking(true), each infoset is guarded by one of a few thousand spinlocks: solvers
+  // update a view between lock and unlock (which do nothing otherwise), and gets and regret
+  // matching take the same lock. Never hold one while getting another infoset.
+  void setLocking(bool on); 
+  void lock(const InfosetView & view); 
+  void unlock(const InfosetView & view); 
+
+  // Software prefetch, for traversals that know which infosets they will get next (the 
+  // children of a node, while recursing into the previous one). prefetchIndex starts loading
+  // the index slot of a key. prefetch reads the slot (a stall, unless it was prefetched a step
+  // earlier) and starts loading the infoset's block; prefetchAll does it for getAll's blocks.
+  // They do nothing when the table is small enough to stay in cache, unless turned on with
+  // setPrefetching. issbench measures what they save.
+  void prefetchIndex(unsigned long long infoset_key) { if (prefetching) prefetchSlot(infoset_key); }
+  void prefetch(unsigned long long infoset_key, int moves) { if (prefetching) prefetchBlocks(infoset_key, blockCells(moves)); }
+  void prefetchAll(unsigned long long bidseq, int player, int moves) { if (prefetching) prefetchGroup(bidseq, player, moves); }
+  void setPrefetching(bool on) { prefetching = on; }
+  bool isPrefetching() { return prefetching; }
+
+  // views of all the infosets of player at bidseq, views[i] for chance outcome i+1 (for the
+  // public tree algorithms). Returns how many there are (0 if not found).
+  int getAll(unsigned long long bidseq, int player, InfosetView * views, int moves, bool match = true);
+
   void writeBytes(std::ofstream & out, void * addr, unsigned int num);  
   void readBytes(std::ifstream & in, void * addr, unsigned int num); 
+  unsigned long long readHeader(std::ifstream & in, unsigned long long & idxsize, unsigned long long & tblsize, bool & legacy, 
+                                unsigned long long & valueFormat);
 
   void dumpToDisk(std::string filename);
   bool readFromDisk(std::string filename);
 
+  // A compact format for keeping many snapshots: only the used index entries, delta-encoded,
+  // and the table (byte-shuffled, if asked to) through zlib. readFromDisk reads them too.
+  // (Shuffling helps smooth values; on Bluff(1,1) strategies it compresses slightly worse.)
+  void dumpCompressedToDisk(std::string filename, bool shuffle = false);
+  bool readCompressedFromDisk(std::string filename);
+
+  // Uses the file in place instead of reading it: pages are loaded as they are touched.
+  // With shared = false, changes stay in memory (copy-on-write). With shared = true, they 
+  // go to the file; a checkpoint (syncToDisk, or dumpToDisk to the same file) is an msync.
+  // Files in older formats are read with readFromDisk.
+  bool mapFromDisk(std::string filename, bool shared = false);
+  void syncToDisk(); 
+
+  // Delta files only hold the infosets updated after iteration since (by lastUpdate), to be
+  // applied on top of the strategies they were taken from. isDeltaFile gets since.
+  void dumpDeltaToDisk(std::string filename, unsigned long long since); 
+  bool applyDeltaFromDisk(std::string filename); 
+  static bool isDeltaFile(std::string filename, unsigned long long & since); 
+
   bool contains(unsigned long long infoset_key);
 
   void printValues(); 
   void computeBound(double & sum_RTimm1, double & sum_RTimm2); 
 
+  // rounds every regret and average strategy sum to the nearest float, as a store 
+  // compiled with ISS_FLOAT would have them
+  void roundToFloat(); 
+
   // used to save memory when evaluation strategies from 2 diff strat files
   void importValues(int player, std::string filename);
 
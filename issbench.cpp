@@ -0,0 +1,110 @@
+#include <cassert>
+#include <iostream>
+#include <cstdlib>
+
+#include "bluff.h"
+#include "simd.h"
+
+using namespace std;
+
+// What software prefetching (InfosetStore::prefetch) saves on a store too big for the cache.
+//
+// Builds a store of made-up infosets (hash index, 1 to 13 actions each, 4 million by default:
+// about 500 MB of table) and gets them the way the traversals do: groups of siblings, each regret
+// matched and then updated, without and then with the next siblings prefetched. The keys
+// are random, so nearly every get goes to DRAM.
+//
+// Usage: issbench [millions of infosets] [millions of gets]   (or: make bench)
+
+#define SIBLINGS 6
+
+static InfosetStore store;
+
+static unsigned long long benchKey(unsigned long long n)
+{
+  // spread out, so that the store keeps its hash index
+  return n * 0x9E3779B97F4A7C15ULL;
+}
+
+static int benchMoves(unsigned long long n)
+{
+  return static_cast<int>(1 + n % (BLUFFBID));
+}
+
+static double run(const unsigned long long * gets, unsigned long long numGets, bool prefetch)
+{
+  store.setPrefetching(prefetch);
+  double moveEVs[BLUFFBID] = { 0.0 };
+  StopWatch sw;
+
+  for (unsigned long long g = 0; g < numGets; g += SIBLINGS)
+  {
+    const unsigned long long * siblings = gets + g;
+
+    // as in cfr: the data of the next sibling, the index slot of the one after
+    store.prefetch(benchKey(siblings[0]), benchMoves(siblings[0]));
+    store.prefetchIndex(benchKey(siblings[1]));
+
+    for (int s = 0; s < SIBLINGS; s++)
+    {
+      if (s+1 < SIBLINGS) store.prefetch(benchKey(siblings[s+1]), benchMoves(siblings[s+1]));
+      if (s+2 < SIBLINGS) store.prefetchIndex(benchKey(siblings[s+2]));
+
+      InfosetView is;
+      int moves = benchMoves(siblings[s]);
+      bool ret = store.getView(benchKey(siblings[s]), is, moves);
+      assert(ret);
+
+      moveEVs[s % moves] += 1.0;
+      addScaledDiff(is.cfrArray(), moveEVs, 0.5, 1.0, moves);
+      addScaled(is.totalMoveProbsArray(), is.curMoveProbs, 1.0, moves);
+    }
+  }
+
+  double secs = sw.stop();
+  return secs*1e9 / static_cast<double>(numGets);
+}
+
+int main(int argc, char ** argv)
+{
+  init();
+
+  unsigned long long numInfosets = 4000000ULL;
+  unsigned long long numGets = 12000000ULL;
+  if (argc >= 2) numInfosets = static_cast<unsigned long long>(to_double(argv[1])*1e6);
+  if (argc >= 3) numGets = static_cast<unsigned long long>(to_double(argv[2])*1e6);
+  numGets -= numGets % SIBLINGS;
+
+  cout << "Adding " << numInfosets << " infosets..." << endl;
+  unsigned long long cells = 0;
+  for (unsigned long long n = 0; n < numInfosets; n++)
+    cells += blockCells(benchMoves(n));
+
+  store.init(cells, numInfosets*2);
+  for (unsigned long long n = 0; n < numInfosets; n++)
+  {
+    Infoset is;
+    newInfoset(is, benchMoves(n));
+    store.put(benchKey(n), is, benchMoves(n), 0);
+  }
+  store.stopAdding();
+  cout << "Table: " << (cells*8.0/1048576.0) << " MB" << endl;
+
+  unsigned long long * gets = new unsigned long long [numGets];
+  for (unsigned long long g = 0; g < numGets; g++)
+    gets[g] = static_cast<unsigned long long>(unifRand01()*numInfosets) % numInfosets;
+
+  // twice each, alternating, the first round also warms up the pages
+  double plain = 0.0, prefetched = 0.0;
+  for (int r = 0; r < 2; r++)
+  {
+    plain = run(gets, numGets, false);
+    prefetched = run(gets, numGets, true);
+    cout << "round " << (r+1) << ": " << plain << " ns per get, " << prefetched << " ns prefetched" << endl;
+  }
+
+  cout << "prefetching saves " << (100.0*(plain - prefetched)/plain) << "% of the time per get" << endl;
+
+  delete [] gets;
+  return 0;
+}
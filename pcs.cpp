@@ -4,7 +4,9 @@
 #include <cstdlib>
 
 #include "bluff.h"
+#include "simd.h"
 #include "svector.h"
+#include "tasks.h"
 
 using namespace std; 
 
@@ -14,6 +16,27 @@ using namespace std;
 typedef SVector<P1CO> covector1;
 typedef SVector<P2CO> covector2;
 
+// nodes touched during the current traversal (added to nodesTouched after it)
+static TaskCounter traversalNodes;
+
+void pcs(GameState & gs, int player, int depth, unsigned long long bidseq, 
+         int updatePlayer, covector1 & reach1, covector2 & reach2, 
+         int phase, covector1 & result1, covector2 & result2);
+
+// a child's subtree, traversed as a task (see tasks.h)
+struct PcsChild
+{
+  GameState gs;
+  unsigned long long bidseq;
+  covector1 reach1;
+  covector2 reach2;
+  int player, depth, phase, updatePlayer;
+  covector1 EV1;
+  covector2 EV2;
+
+  void run() { pcs(gs, player, depth, bidseq, updatePlayer, reach1, reach2, phase, EV1, EV2); }
+};
+
 void handleLeaf(GameState & gs, int updatePlayer, covector1 & reach1, covector2 & reach2, 
                 covector1 & result1, covector2 & result2)
 {
@@ -96,6 +119,35 @@ void handleLeaf(GameState & gs, int updatePlayer, covector1 & reach1, covector2
   }
 }
 
+// adds what the child after action returned to the results of its parent
+static void addChildEVs(int player, int updatePlayer, int action, covector1 & EV1, covector2 & EV2, 
+                        covector1 & moveProbs1, covector2 & moveProbs2, covector1 * moveEVs1, 
+                        covector2 * moveEVs2, covector1 & result1, covector2 & result2)
+{
+  if (player == updatePlayer)
+  {
+    if (player == 1)
+    {
+      moveEVs1[action] = EV1;
+      EV1 *= moveProbs1;
+      result1 += EV1;
+    }
+    else if (player == 2)
+    {
+      moveEVs2[action] = EV2;
+      EV2 *= moveProbs2;
+      result2 += EV2;
+    }
+  }
+  else 
+  {
+    if (updatePlayer == 1)    
+      result1 += EV1;
+    else if (updatePlayer == 2)    
+      result2 += EV2;
+  }
+}
+
 void pcs(GameState & gs, int player, int depth, unsigned long long bidseq, 
          int updatePlayer, covector1 & reach1, covector2 & reach2, 
          int phase, covector1 & result1, covector2 & result2)
@@ -111,7 +163,7 @@ void pcs(GameState & gs, int player, int depth, unsigned long long bidseq,
     return;
   }
   
-  nodesTouched++;
+  traversalNodes.inc();
 
   // chance nodes (just bogus entries)
   // note: for expected values to make sense, should iterate over each move.
@@ -170,37 +222,22 @@ void pcs(GameState & gs, int player, int depth, unsigned long long bidseq,
 
   // get the infosets here (one per outcome)
 
-  unsigned long long infosetkeys[co];
-  Infoset is[co];  
+  InfosetView is[co];  
  
   // only one of these is used
   covector1 moveEVs1[actionshere];
   covector2 moveEVs2[actionshere];
 
-  for (int i = 0; i < co; i++)
-  {
-    int outcome = i+1;
+  // get the info sets, which sit together in the store (also sets is[i].curMoveProbs using 
+  // regret matching)
+  int found = iss.getAll(bidseq, player, is, actionshere); 
+  assert(found == co);
 
-    infosetkeys[i] = bidseq; 
-    infosetkeys[i] <<= iscWidth; 
-    if (player == 1)
-    {
-      infosetkeys[i] |= outcome; 
-      infosetkeys[i] <<= 1; 
-      // get the info set (also set is.curMoveProbs using regret matching)
-      bool ret = iss.get(infosetkeys[i], is[i], actionshere, 0); 
-      assert(ret);
-    }
-    else if (player == 2)
-    {
-      infosetkeys[i] |= outcome; 
-      infosetkeys[i] <<= 1; 
-      infosetkeys[i] |= 1; 
-      // get the info set (also set is.curMoveProbs using regret matching)
-      bool ret = iss.get(infosetkeys[i], is[i], actionshere, 0); 
-      assert(ret);
-    }
-  }
+  // near the root, the children are traversed as tasks (only the infosets here are updated
+  // here, and only after all of them are done)
+  bool spawn = spawnTasks(depth); 
+  PcsChild children[spawn ? actionshere : 1]; 
+  TaskGroup group; 
 
   // iterate over the actions
 
@@ -209,6 +246,10 @@ void pcs(GameState & gs, int player, int depth, unsigned long long bidseq,
     action++;
     assert(action < actionshere);
 
+    // the next child's infosets are fetched while this one is traversed (bluff ends the game)
+    if (i+1 < BLUFFBID) 
+      iss.prefetchAll(bidseq | (1ULL << (BLUFFBID-i-1)), 3-player, BLUFFBID-i-1); 
+
     // only one of these is used
     covector1 moveProbs1;
     covector2 moveProbs2;
@@ -235,29 +276,47 @@ void pcs(GameState & gs, int player, int depth, unsigned long long bidseq,
     unsigned long long newbidseq = bidseq;
     newbidseq |= (1ULL << (BLUFFBID-i)); 
 
+    if (spawn) 
+    {
+      PcsChild & child = children[action]; 
+      child.gs = ngs; 
+      child.bidseq = newbidseq; 
+      child.reach1 = newReach1; 
+      child.reach2 = newReach2; 
+      child.player = 3-player; 
+      child.depth = depth+1; 
+      child.phase = phase; 
+      child.updatePlayer = updatePlayer; 
+      group.spawn(child); 
+      continue; 
+    }
+
     pcs(ngs, 3-player, depth+1, newbidseq, updatePlayer, newReach1, newReach2, phase, EV1, EV2); 
 
-    if (player == updatePlayer)
+    addChildEVs(player, updatePlayer, action, EV1, EV2, moveProbs1, moveProbs2, moveEVs1, moveEVs2, 
+                result1, result2); 
+  }
+
+  if (spawn) 
+  {
+    group.wait(); 
+
+    // in the serial order
+    for (int a = 0; a < actionshere; a++) 
     {
-      if (player == 1)
-      {
-        moveEVs1[action] = EV1;
-        EV1 *= moveProbs1;
-        result1 += EV1;
-      }
-      else if (player == 2)
+      covector1 moveProbs1;
+      covector2 moveProbs2;
+
+      for (int o = 0; o < co; o++) 
       {
-        moveEVs2[action] = EV2;
-        EV2 *= moveProbs2;
-        result2 += EV2;
+        if (player == 1)
+          moveProbs1[o] = is[o].curMoveProbs[a];
+        else if (player == 2)
+          moveProbs2[o] = is[o].curMoveProbs[a]; 
       }
-    }
-    else 
-    {
-      if (updatePlayer == 1)    
-        result1 += EV1;
-      else if (updatePlayer == 2)    
-        result2 += EV2;
+
+      addChildEVs(player, updatePlayer, a, children[a].EV1, children[a].EV2, moveProbs1, moveProbs2, 
+                  moveEVs1, moveEVs2, result1, result2); 
     }
   }
 
@@ -266,18 +325,18 @@ void pcs(GameState & gs, int player, int depth, unsigned long long bidseq,
   if (player == updatePlayer && phase == 1)
   {
     // regrets will be changed, so make sure to indicate it to prob updater
-    for (int o = 0; o < co; o++)
-      is[o].lastUpdate = iter;
-
     for (int o = 0; o < co; o++)
     {
+      double moveEVs[actionshere]; 
       for (int a = 0; a < actionshere; a++)
-      {
-        double moveEV = (player == 1 ? moveEVs1[a][o] : moveEVs2[a][o]);
-        double resulto = (player == 1 ? result1[o] : result2[o]); 
+        moveEVs[a] = (player == 1 ? moveEVs1[a][o] : moveEVs2[a][o]);
 
-        is[o].cfr[a] += (moveEV - resulto); 
-      }
+      double resulto = (player == 1 ? result1[o] : result2[o]); 
+
+      iss.lock(is[o]); 
+      is[o].setLastUpdate(iter);
+      addScaledDiff(is[o].cfrArray(), moveEVs, resulto, 1.0, actionshere); 
+      iss.unlock(is[o]); 
     }
   }
 
@@ -285,21 +344,12 @@ void pcs(GameState & gs, int player, int depth, unsigned long long bidseq,
   {
     for (int o = 0; o < co; o++)
     {
-      for (int a = 0; a < actionshere; a++)
-      {
-        double my_prob = (player == 1 ? reach1[o] : reach2[o]);
+      double my_prob = (player == 1 ? reach1[o] : reach2[o]);
 
-        // update total probs
-        is[o].totalMoveProbs[a] += my_prob*is[o].curMoveProbs[a];
-      }
-    }
-  }
-
-  if (player == updatePlayer) 
-  {
-    for (int o = 0; o < co; o++) 
-    {
-      iss.put(infosetkeys[o], is[o], actionshere, 0); 
+      // update total probs
+      iss.lock(is[o]); 
+      addScaled(is[o].totalMoveProbsArray(), is[o].curMoveProbs, my_prob, actionshere); 
+      iss.unlock(is[o]); 
     }
   }
 
@@ -313,6 +363,7 @@ int main(int argc, char ** argv)
   unsigned long long maxNodesTouched = 0; 
   unsigned long long maxIters = 0; 
   init();
+  parseOptions(argc, argv);
 
   if (argc < 2)
   {
@@ -323,10 +374,13 @@ int main(int argc, char ** argv)
   { 
     string filename = argv[1];
     cout << "Reading the infosets from " << filename << "..." << endl;
-    iss.readFromDisk(filename);
+    iss.mapFromDisk(filename);
 
     if (argc >= 3)
       maxIters = to_ull(argv[2]);
+
+    if (argc >= 4)
+      initTasks(to_int(argv[3]));
   }  
   
   // get the iteration
@@ -364,6 +418,8 @@ int main(int argc, char ** argv)
     reach2.reset(1.0);
     pcs(gs2, 1, 0, bidseq, 2, reach1, reach2, 1, result1, result2);
 
+    nodesTouched += traversalNodes.take(); 
+
     if (iter % 10 == 0)
     { 
       cout << "."; cout.flush(); 
@@ -5,13 +5,15 @@
 #include <cstring>
 
 #include "bluff.h"
+#include "simd.h"
 
 /**
  * Note: this implementation is based on the pseudo-code in Richard Gibson's Ph.D. thesis
  *
- * It uses the same data structure (infosetstore) as the rest, but a custom implementation
- * might want to use a different one since doubles could be replaced by integers, saving 
- * a lot of memory. 
+ * It uses the same data structure (infosetstore) as the rest, but built with -DISS_INT (see 
+ * the Makefile): payoffs are +/-1, so the regrets are integers and the average strategy is
+ * a count of the sampled actions. That takes half the memory of doubles, and actions are 
+ * sampled straight from the integer regrets, without regret matching.
  */
 
 using namespace std; 
@@ -57,7 +59,7 @@ double purecfr(GameState & gs, int player, int depth, unsigned long long bidseq,
   }
   
   // declare the variables
-  Infoset is;
+  InfosetView is;
   unsigned long long infosetkey = 0;
   int action = -1;
   
@@ -69,13 +71,11 @@ double purecfr(GameState & gs, int player, int depth, unsigned long long bidseq,
   for (int i = 0; i < actionshere; i++) 
     moveEVs[i] = 0.0;
 
-  // get the info set (also set is.curMoveProbs using regret matching)
-  getInfoset(gs, player, bidseq, is, infosetkey, actionshere); 
+  // get the info set (no regret matching: the action is sampled from the regrets)
+  getInfoset(gs, player, bidseq, is, infosetkey, actionshere, false); 
 
   // sample opponent nodes
-  double sampleprob = -1; 
-  int takeAction = sampleAction(is, actionshere, sampleprob, 0.0, false); 
-  CHKPROBNZ(sampleprob); 
+  int takeAction = sampleRegretAction(is, actionshere); 
 
   // take the action. find the i for this action
   int i;
@@ -115,21 +115,19 @@ double purecfr(GameState & gs, int player, int depth, unsigned long long bidseq,
 
   if (player == updatePlayer) 
   {
-    for (int a = 0; a < actionshere; a++)
-      is.cfr[a] += (moveEVs[a] - moveEVs[takeAction]);
+    addScaledDiff(is.cfrArray(), moveEVs, moveEVs[takeAction], 1.0, actionshere); 
   }
 
   // on opponent node, update the average strategy
 
   if (player != updatePlayer) 
   {
-    is.totalMoveProbs[takeAction] += 1.0; 
+    storeValue(is.totalMoveProbs(takeAction), is.totalMoveProbs(takeAction) + 1.0); 
   }
-  
-  // we're always  updating, so save back to the store
-  //ttlUpdates++;
-  iss.put(infosetkey, is, actionshere, 0); 
- 
+
+  // the infoset changed in this iteration (delta checkpoints only save those)
+  is.setLastUpdate(iter); 
+
   return moveEVs[takeAction];
 }
 
@@ -137,6 +135,7 @@ double purecfr(GameState & gs, int player, int depth, unsigned long long bidseq,
 int main(int argc, char ** argv) 
 {
   init();
+  parseOptions(argc, argv);
   unsigned long long maxNodesTouched = 0; 
 
   if (argc < 2)
@@ -148,7 +147,7 @@ int main(int argc, char ** argv)
   else
   {
     cout << "Reading infosets from " << argv[1] << endl;
-    if (!iss.readFromDisk(argv[1]))
+    if (!loadCheckpoint(argv[1]))
     {
       cerr << "Problem reading file. " << endl; 
       exit(-1); 
@@ -156,6 +155,8 @@ int main(int argc, char ** argv)
     
     if (argc >= 3) 
       runname = argv[2];
+    else   
+      runname = "bluff11";
   }
   
   // get the iteration
@@ -213,8 +214,7 @@ int main(int argc, char ** argv)
       conv = computeBestResponses(false);
       string str = "purecfr.bluff11.report.txt"; 
       report(str, totaltime, 2.0*MAX(b1,b2), conv);
-      //dumpInfosets("iss-" + runname); 
-      //dumpMetaData("metainfo-" + runname, totaltime); 
+      checkpoint(runname, totaltime); 
 
       cout << "Report done at: " << getCurDateTime() << endl;
 
@@ -228,6 +228,8 @@ int main(int argc, char ** argv)
       break;
   }
   
+  finishCheckpoints(); 
+
   return 0;
 }
 
@@ -2,8 +2,11 @@
 #include <cassert>
 #include <cstdlib>
 #include <iostream>
+#include <vector>
 
 #include "bluff.h"
+#include "simd.h"
+#include "tasks.h"
 
 using namespace std;
 
@@ -59,7 +62,7 @@ void sampleMoveAvg(Infoset & is, int actionshere, int & index, double & prob)
 
 }
 
-int sampleAction(Infoset & is, int actionshere, double & sampleprob, double epsilon, bool firstTimeUniform)
+int sampleAction(InfosetView & is, int actionshere, double & sampleprob, double epsilon, bool firstTimeUniform)
 {
 
   // **Only do this when enabled by firstTimeUniform:
@@ -68,7 +71,7 @@ int sampleAction(Infoset & is, int actionshere, double & sampleprob, double epsi
   //
   double eps = 0.0;
   if (firstTimeUniform)
-    eps = (is.lastUpdate == 0 ? 1.0 : epsilon);
+    eps = (is.getLastUpdate() == 0 ? 1.0 : epsilon);
   else
     eps = epsilon;
 
@@ -93,3 +96,189 @@ int sampleAction(Infoset & is, int actionshere, double & sampleprob, double epsi
   assert(false);
   return -1;
 }
+
+// Pure CFR: samples an action with probability proportional to its positive regret (uniformly
+// if none is positive) straight from the regrets in the store, without computing the strategy
+int sampleRegretAction(InfosetView & is, int actionshere)
+{
+  const RegretValue * regrets = is.cfrArray();
+
+  // exact for integer regrets
+  double totPosReg = 0.0;
+  for (int a = 0; a < actionshere; a++)
+    if (regrets[a] > 0)
+      totPosReg += regrets[a];
+
+  if (totPosReg <= 0.0)
+    return MIN(static_cast<int>(unifRand01()*actionshere), actionshere-1);
+
+  double roll = unifRand01()*totPosReg;
+  double sum = 0.0;
+  int last = -1;
+  for (int a = 0; a < actionshere; a++)
+  {
+    if (regrets[a] <= 0)
+      continue;
+
+    sum += regrets[a];
+    last = a;
+    if (roll < sum)
+      return a;
+  }
+
+  // only when the roll was rounded up to the total
+  assert(last >= 0);
+  return last;
+}
+
+// what the tasks of runSamplingThreads share
+static unsigned long long (*threadIteration)(int thread) = NULL;
+static unsigned long long threadIters = 1;
+static unsigned long long nodesTarget = 0;
+static volatile bool stopThreads = false;
+
+// runs iterations until told to stop, on whichever worker takes it
+struct SamplingTask
+{
+  int thread;
+  unsigned long long seed;
+
+  void run()
+  {
+    // the worker may be the main thread (waiting for the group), which keeps its own stream
+    ThreadRandState saved;
+    saveThreadRand(saved);
+    seedThreadRand(seed);
+
+    while (!stopThreads)
+    {
+      unsigned long long nodes = threadIteration(thread);
+
+      // the iterations count as in a serial run (the infosets are stamped with iter)
+      __sync_fetch_and_add(&iter, threadIters);
+      if (__sync_add_and_fetch(&nodesTouched, nodes) >= nodesTarget)
+        stopThreads = true;
+    }
+
+    restoreThreadRand(saved);
+  }
+};
+
+// Calls iteration (which runs iters iterations and returns the # of nodes it touched) on each
+// of the task threads (see tasks.h), numbered from 0, until nodesTouched reaches target. They
+// all work on the same store: updates to an infoset from different threads are not 
+// synchronized (Hogwild), which sampling tolerates much like the noise it already has. Each 
+// thread samples from its own random stream, seeded from this thread's. On return iter is the
+// last iteration done.
+void runSamplingThreads(unsigned long long (*iteration)(int thread), unsigned long long iters, 
+                        unsigned long long target)
+{
+  threadIteration = iteration;
+  threadIters = iters;
+  nodesTarget = target;
+  stopThreads = false;
+
+  vector<SamplingTask> tasks(taskThreads);
+  TaskGroup group;
+  for (int t = 0; t < taskThreads; t++)
+  {
+    tasks[t].thread = t;
+    tasks[t].seed = static_cast<unsigned long long>(unifRand01()*4294967296.0);
+    group.spawn(tasks[t]);
+  }
+  group.wait();
+
+  iter--;
+}
+
+UpdateBuffer::UpdateBuffer(unsigned int expectedInfosets)
+{
+  unsigned int size = 64;
+  while (size < 2ULL*expectedInfosets)
+    size *= 2;
+
+  slots.assign(size, -1);
+  slotMask = size-1;
+  infosets.reserve(MIN(expectedInfosets, 65536U));
+}
+
+static inline unsigned int bufferSlot(unsigned long long key, unsigned int mask)
+{
+  return static_cast<unsigned int>((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+// twice the slots, when half of them are taken
+void UpdateBuffer::grow()
+{
+  slots.assign(2*slots.size(), -1);
+  slotMask = slots.size()-1;
+
+  for (size_t i = 0; i < infosets.size(); i++)
+  {
+    unsigned int slot = bufferSlot(infosets[i].key, slotMask);
+    while (slots[slot] >= 0)
+      slot = (slot+1) & slotMask;
+
+    slots[slot] = static_cast<int>(i);
+    infosets[i].slot = slot;
+  }
+}
+
+int UpdateBuffer::find(GameState & gs, int player, unsigned long long bidseq, int actionshere)
+{
+  unsigned long long key = getInfosetKey(gs, player, bidseq);
+  unsigned int slot = bufferSlot(key, slotMask);
+
+  for (; slots[slot] >= 0; slot = (slot+1) & slotMask)
+    if (infosets[slots[slot]].key == key)
+      return slots[slot];
+
+  if (2*(infosets.size()+1) > slots.size())
+  {
+    grow();
+    for (slot = bufferSlot(key, slotMask); slots[slot] >= 0; slot = (slot+1) & slotMask)
+      ;
+  }
+
+  // first time: get it from the store (also sets is.curMoveProbs)
+  int index = static_cast<int>(infosets.size());
+  infosets.resize(index+1);
+  BufferedInfoset & bis = infosets[index];
+  bis.slot = slot;
+  bis.player = player;
+  bis.actionshere = actionshere;
+  getInfoset(gs, player, bidseq, bis.is, bis.key, actionshere);
+  bis.regretsChanged = false;
+  bis.averageChanged = false;
+  for (int a = 0; a < actionshere; a++)
+    bis.regretDelta[a] = 0.0;
+  bis.avgWeight = 0.0;
+
+  slots[slot] = index;
+  return index;
+}
+
+void UpdateBuffer::apply()
+{
+  for (size_t i = 0; i < infosets.size(); i++)
+  {
+    BufferedInfoset & bis = infosets[i];
+    iss.lock(bis.is);
+
+    if (bis.regretsChanged)
+    {
+      addScaledDiff(bis.is.cfrArray(), bis.regretDelta, 0.0, 1.0, bis.actionshere);
+      bis.is.regretsUpdated();
+    }
+
+    if (bis.averageChanged)
+      addScaled(bis.is.totalMoveProbsArray(), bis.is.curMoveProbs, bis.avgWeight, bis.actionshere);
+
+    // the infoset changed in this iteration (delta checkpoints only save those)
+    bis.is.setLastUpdate(iter);
+    iss.unlock(bis.is);
+    slots[bis.slot] = -1;
+  }
+
+  infosets.clear();
+}
@@ -0,0 +1,212 @@
+
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <cassert>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+
+/*
+ * Vectorized kernels for the per-infoset loops of the solvers. The store keeps the
+ * regrets and the average strategy sums of an infoset in two contiguous arrays (see
+ * InfosetView), so these run straight over them.
+ *
+ * AVX is used when compiling with -mavx2 (or -march=native), otherwise SSE2, which
+ * every x86-64 has. Other platforms get the plain loops.
+ */
+
+// regret matching: probs[a] = r+[a] / sum_b r+[b], or uniform if no regret is positive
+inline void regretMatching(const double * regrets, double * probs, int n)
+{
+#ifndef NDEBUG
+  for (int a = 0; a < n; a++)
+  {
+    int c = std::fpclassify(regrets[a]);
+    assert(c == FP_NORMAL || c == FP_ZERO);
+  }
+#endif
+
+  int a = 0;
+
+  // clamp to the positive part
+#if defined(__AVX__)
+  __m256d zero4 = _mm256_setzero_pd();
+  for (; a+4 <= n; a += 4)
+    _mm256_storeu_pd(probs+a, _mm256_max_pd(_mm256_loadu_pd(regrets+a), zero4));
+#elif defined(__SSE2__)
+  __m128d zero2 = _mm_setzero_pd();
+  for (; a+2 <= n; a += 2)
+    _mm_storeu_pd(probs+a, _mm_max_pd(_mm_loadu_pd(regrets+a), zero2));
+#endif
+  for (; a < n; a++)
+    probs[a] = (regrets[a] > 0.0 ? regrets[a] : 0.0);
+
+  // summed in order, so that the strategy does not depend on the vector width
+  double totPosReg = 0.0;
+  for (a = 0; a < n; a++)
+    totPosReg += probs[a];
+
+  if (totPosReg <= 0.0)
+  {
+    for (a = 0; a < n; a++)
+      probs[a] = 1.0/n;
+    return;
+  }
+
+  a = 0;
+#if defined(__AVX__)
+  __m256d tot4 = _mm256_set1_pd(totPosReg);
+  for (; a+4 <= n; a += 4)
+    _mm256_storeu_pd(probs+a, _mm256_div_pd(_mm256_loadu_pd(probs+a), tot4));
+#elif defined(__SSE2__)
+  __m128d tot2 = _mm_set1_pd(totPosReg);
+  for (; a+2 <= n; a += 2)
+    _mm_storeu_pd(probs+a, _mm_div_pd(_mm_loadu_pd(probs+a), tot2));
+#endif
+  for (; a < n; a++)
+    probs[a] = probs[a] / totPosReg;
+}
+
+// regret update: dst[a] += scale*(vals[a] - base)
+inline void addScaledDiff(double * dst, const double * vals, double base, double scale, int n)
+{
+  int a = 0;
+
+#if defined(__AVX__)
+  __m256d base4 = _mm256_set1_pd(base);
+  __m256d scale4 = _mm256_set1_pd(scale);
+  for (; a+4 <= n; a += 4)
+  {
+    __m256d d = _mm256_mul_pd(scale4, _mm256_sub_pd(_mm256_loadu_pd(vals+a), base4));
+    _mm256_storeu_pd(dst+a, _mm256_add_pd(_mm256_loadu_pd(dst+a), d));
+  }
+#elif defined(__SSE2__)
+  __m128d base2 = _mm_set1_pd(base);
+  __m128d scale2 = _mm_set1_pd(scale);
+  for (; a+2 <= n; a += 2)
+  {
+    __m128d d = _mm_mul_pd(scale2, _mm_sub_pd(_mm_loadu_pd(vals+a), base2));
+    _mm_storeu_pd(dst+a, _mm_add_pd(_mm_loadu_pd(dst+a), d));
+  }
+#endif
+
+  for (; a < n; a++)
+    dst[a] += scale*(vals[a] - base);
+}
+
+// average strategy accumulation: dst[a] += scale*src[a]
+inline void addScaled(double * dst, const double * src, double scale, int n)
+{
+  int a = 0;
+
+#if defined(__AVX__)
+  __m256d scale4 = _mm256_set1_pd(scale);
+  for (; a+4 <= n; a += 4)
+  {
+    __m256d d = _mm256_mul_pd(scale4, _mm256_loadu_pd(src+a));
+    _mm256_storeu_pd(dst+a, _mm256_add_pd(_mm256_loadu_pd(dst+a), d));
+  }
+#elif defined(__SSE2__)
+  __m128d scale2 = _mm_set1_pd(scale);
+  for (; a+2 <= n; a += 2)
+  {
+    __m128d d = _mm_mul_pd(scale2, _mm_loadu_pd(src+a));
+    _mm_storeu_pd(dst+a, _mm_add_pd(_mm_loadu_pd(dst+a), d));
+  }
+#endif
+
+  for (; a < n; a++)
+    dst[a] += scale*src[a];
+}
+
+/*
+ * The same for stores with float values (-DISS_FLOAT). Everything is computed in double and
+ * rounded once when stored. Results too small for a normal float are flushed to 0 and ones too 
+ * large saturate, so a regret never becomes subnormal (slow) or infinite (poisons the sums).
+ */
+
+inline float toStoreFloat(double x)
+{
+  double ax = fabs(x); 
+  if (ax < FLT_MIN) 
+    return 0.0f; 
+  if (ax > FLT_MAX) 
+    return (x > 0 ? FLT_MAX : -FLT_MAX); 
+  return static_cast<float>(x); 
+}
+
+inline void storeValue(double & dst, double x) { dst = x; }
+inline void storeValue(float & dst, double x) { dst = toStoreFloat(x); }
+
+inline void regretMatching(const float * regrets, double * probs, int n)
+{
+  double totPosReg = 0.0;
+  for (int a = 0; a < n; a++)
+  {
+    assert(std::fpclassify(regrets[a]) == FP_NORMAL || std::fpclassify(regrets[a]) == FP_ZERO);
+    probs[a] = (regrets[a] > 0.0f ? static_cast<double>(regrets[a]) : 0.0);
+    totPosReg += probs[a];
+  }
+
+  for (int a = 0; a < n; a++)
+    probs[a] = (totPosReg > 0.0 ? probs[a] / totPosReg : 1.0/n);
+}
+
+inline void addScaledDiff(float * dst, const double * vals, double base, double scale, int n)
+{
+  for (int a = 0; a < n; a++)
+    dst[a] = toStoreFloat(dst[a] + scale*(vals[a] - base));
+}
+
+inline void addScaled(float * dst, const double * src, double scale, int n)
+{
+  for (int a = 0; a < n; a++)
+    dst[a] = toStoreFloat(dst[a] + scale*src[a]);
+}
+
+/*
+ * And for integer stores (-DISS_INT): int regrets and unsigned average strategy counts.
+ * Results are rounded to the nearest integer and saturate instead of wrapping around.
+ */
+
+inline void storeValue(int & dst, double x) 
+{ 
+  dst = (x >= INT_MAX ? INT_MAX : x <= INT_MIN ? INT_MIN : static_cast<int>(floor(x + 0.5))); 
+}
+
+inline void storeValue(unsigned int & dst, double x) 
+{ 
+  dst = (x >= UINT_MAX ? UINT_MAX : x <= 0.0 ? 0U : static_cast<unsigned int>(x + 0.5)); 
+}
+
+inline void regretMatching(const int * regrets, double * probs, int n)
+{
+  long long totPosReg = 0;
+  for (int a = 0; a < n; a++)
+    totPosReg += (regrets[a] > 0 ? regrets[a] : 0);
+
+  for (int a = 0; a < n; a++)
+    probs[a] = (totPosReg > 0 ? (regrets[a] > 0 ? regrets[a] : 0) / static_cast<double>(totPosReg) : 1.0/n);
+}
+
+inline void addScaledDiff(int * dst, const double * vals, double base, double scale, int n)
+{
+  for (int a = 0; a < n; a++)
+    storeValue(dst[a], dst[a] + scale*(vals[a] - base));
+}
+
+inline void addScaled(unsigned int * dst, const double * src, double scale, int n)
+{
+  for (int a = 0; a < n; a++)
+    storeValue(dst[a], dst[a] + scale*src[a]);
+}
+
+#endif
+
@@ -0,0 +1,65 @@
+#include <iostream>
+#include <cstdlib>
+
+#include "bluff.h"
+
+using namespace std;
+
+// What storing the values as floats (-DISS_FLOAT) costs in exploitability.
+//
+// With one strategies file: the exploitability of its strategy, and of the same strategy
+// with every regret and average strategy sum rounded to float (what a float store holding
+// the same sums would play). With two files, e.g. the same run with and without ISS_FLOAT:
+// the exploitability of both. Files of either value size (and checkpoint deltas) can be given
+// to either build.
+
+static double exploitability(string filename)
+{
+  cout << "Reading the infosets from " << filename << "..." << endl;
+  if (!loadCheckpoint(filename))
+  {
+    cerr << "Could not read " << filename << endl;
+    exit(-1);
+  }
+
+  return computeBestResponses(false);
+}
+
+int main(int argc, char ** argv)
+{
+  init();
+
+  if (argc < 2)
+  {
+    cerr << "Usage: storecmp <strategies file> [other strategies file]" << endl;
+    exit(-1);
+  }
+
+  // only used for the bound printed along
+  iter = 1;
+
+  double conv1 = exploitability(argv[1]);
+  double conv2 = 0.0;
+  string what;
+
+  if (argc >= 3)
+  {
+    conv2 = exploitability(argv[2]);
+    what = argv[2];
+  }
+  else
+  {
+    iss.roundToFloat();
+    conv2 = computeBestResponses(false);
+    what = "rounded to float";
+  }
+
+  cout.precision(15);
+  cout << endl;
+  cout << "exploitability of " << argv[1] << " = " << conv1 << endl;
+  cout << "exploitability of " << what << " = " << conv2 << endl;
+  cout << "difference = " << (conv2 - conv1) << endl;
+
+  return 0;
+}
+
@@ -0,0 +1,211 @@
+#include <cassert>
+#include <iostream>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "bluff.h"
+#include "tasks.h"
+
+using namespace std;
+
+// tasks a deque holds, more are run right away by the spawning worker
+#define TASK_DEQUE_SIZE 1024
+
+// how many times an idle worker looks for tasks before it yields the processor to another 
+// thread (each time after that), and before it goes to sleep
+#define YIELD_SPINS 16
+#define IDLE_SPINS 100000
+
+int taskThreads = 1;
+int taskCutoff = 4;
+__thread int taskWorker = 0;
+
+// tasks [top, bottom) (mod the size), under a spinlock: the owner pushes and pops at the
+// bottom, thieves take from the top
+struct TaskDeque
+{
+  volatile int locked;
+  volatile unsigned int top;
+  volatile unsigned int bottom;
+  Task tasks[TASK_DEQUE_SIZE];
+  char pad[64];
+};
+
+static TaskDeque deques[MAX_TASK_THREADS];
+
+// tasks in all the deques, and workers asleep waiting for some
+static volatile int queued = 0;
+static volatile int sleepers = 0;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static pthread_mutex_t sleepMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sleepCond = PTHREAD_COND_INITIALIZER;
+#endif
+
+static inline void lockDeque(TaskDeque & d)
+{
+  while (__sync_lock_test_and_set(&d.locked, 1))
+    while (d.locked)
+      ;
+}
+
+static inline void unlockDeque(TaskDeque & d)
+{
+  __sync_lock_release(&d.locked);
+}
+
+void spawnTask(const Task & task)
+{
+  TaskDeque & d = deques[taskWorker];
+
+  lockDeque(d);
+  bool full = (d.bottom - d.top == TASK_DEQUE_SIZE);
+  if (!full)
+  {
+    d.tasks[d.bottom % TASK_DEQUE_SIZE] = task;
+    d.bottom++;
+  }
+  unlockDeque(d);
+
+  if (full)
+  {
+    task.fn(task.arg);
+    task.group->done();
+    return;
+  }
+
+  __sync_fetch_and_add(&queued, 1);
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (sleepers > 0)
+  {
+    pthread_mutex_lock(&sleepMutex);
+    pthread_cond_broadcast(&sleepCond);
+    pthread_mutex_unlock(&sleepMutex);
+  }
+#endif
+}
+
+// the newest of worker w's own tasks, or the oldest of another's
+static bool takeTask(int w, bool own, Task & task)
+{
+  TaskDeque & d = deques[w];
+  if (d.bottom == d.top)
+    return false;
+
+  lockDeque(d);
+  bool found = (d.bottom != d.top);
+  if (found)
+  {
+    if (own)
+      task = d.tasks[--d.bottom % TASK_DEQUE_SIZE];
+    else
+      task = d.tasks[d.top++ % TASK_DEQUE_SIZE];
+  }
+  unlockDeque(d);
+
+  if (found)
+    __sync_fetch_and_sub(&queued, 1);
+  return found;
+}
+
+// when more threads than cores are running, the one with the task is let in sooner
+static inline void idle(int spins)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+  if (spins > YIELD_SPINS)
+    sched_yield();
+#else
+  (void) spins;
+#endif
+}
+
+bool runTask()
+{
+  Task task;
+  bool found = takeTask(taskWorker, true, task);
+
+  for (int i = 1; !found && i < taskThreads; i++)
+    found = takeTask((taskWorker + i) % taskThreads, false, task);
+
+  if (!found)
+    return false;
+
+  task.fn(task.arg);
+  task.group->done();
+  return true;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void * taskWorkerLoop(void * arg)
+{
+  taskWorker = *static_cast<int *>(arg);
+  delete static_cast<int *>(arg);
+
+  for (int spins = 0; true; )
+  {
+    if (runTask())
+    {
+      spins = 0;
+      continue;
+    }
+
+    if (++spins < IDLE_SPINS)
+    {
+      idle(spins);
+      continue;
+    }
+
+    // between traversals: sleep until a task is spawned
+    pthread_mutex_lock(&sleepMutex);
+    __sync_fetch_and_add(&sleepers, 1);
+    while (queued == 0)
+      pthread_cond_wait(&sleepCond, &sleepMutex);
+    __sync_fetch_and_sub(&sleepers, 1);
+    pthread_mutex_unlock(&sleepMutex);
+    spins = 0;
+  }
+
+  return NULL;
+}
+#endif
+
+void initTasks(int threads)
+{
+  assert(taskThreads == 1);
+  threads = MAX(1, MIN(threads, MAX_TASK_THREADS));
+
+#if !defined(_WIN32) && !defined(_WIN64)
+  // the workers live until the program exits
+  for (int w = 1; w < threads; w++)
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, taskWorkerLoop, new int(w)) != 0)
+    {
+      cerr << "Could only start " << w << " task threads" << endl;
+      threads = w;
+      break;
+    }
+    pthread_detach(thread);
+  }
+
+  taskThreads = threads;
+#endif
+}
+
+void waitForTasks(volatile int & pending)
+{
+  for (int spins = 0; pending > 0; )
+  {
+    if (runTask())
+      spins = 0;
+    else
+      idle(++spins);
+  }
+
+  // the tasks' results are seen after this
+  __sync_synchronize();
+}
@@ -0,0 +1,103 @@
+/**
+ * A small work-stealing runtime for the recursive traversals.
+ */
+#ifndef __TASKS_H__
+#define __TASKS_H__
+
+// A traversal opts in by spawning the subtrees of a node as tasks when spawnTasks(depth) says
+// so, waiting for them, and then going through their results in the usual order (so that the
+// sums come out the same as in a serial traversal):
+//
+//   struct Child { ...the arguments...; double value; void run() { value = traverse(...); } };
+//
+//   if (spawnTasks(depth)) {
+//     TaskGroup group;
+//     for each action: fill children[action], group.spawn(children[action]);
+//     group.wait();
+//   }
+//
+// Each thread (worker) has a deque of tasks: it pushes and pops its own at the bottom, and
+// when it runs out, steals from the top of the others'. A thread waiting for a group runs
+// tasks meanwhile (its own first), so waiting never blocks a worker. With one thread, or
+// below the cutoff depth, nothing is spawned and the traversals are plain recursion.
+
+#define MAX_TASK_THREADS 64
+
+class TaskGroup;
+
+struct Task
+{
+  void (*fn)(void * arg);
+  void * arg;
+  TaskGroup * group;
+};
+
+// starts threads-1 workers; the calling thread is worker 0 (on Windows there are none)
+void initTasks(int threads);
+
+extern int taskThreads;                    // # of workers, the main thread included
+extern int taskCutoff;                     // subtrees are spawned above this depth
+extern __thread int taskWorker;            // the calling thread's worker number
+
+inline bool spawnTasks(int depth) { return taskThreads > 1 && depth < taskCutoff; }
+
+// pushes the task on the calling worker's deque (or runs it, if that is full)
+void spawnTask(const Task & task);
+
+// runs one task from the calling worker's deque, or stolen from another; false if none
+bool runTask();
+
+// runs tasks until pending is 0
+void waitForTasks(volatile int & pending);
+
+class TaskGroup
+{
+  volatile int pending;
+
+  template <class T> static void runCall(void * arg) { static_cast<T *>(arg)->run(); }
+
+public:
+  // has to be waited for before it goes away
+  TaskGroup() : pending(0) { }
+
+  void spawn(void (*fn)(void * arg), void * arg)
+  {
+    __sync_fetch_and_add(&pending, 1);
+    Task task = { fn, arg, this };
+    spawnTask(task);
+  }
+
+  // call.run() as a task; call has to stay around until wait() returns
+  template <class T> void spawn(T & call) { spawn(runCall<T>, &call); }
+
+  void done() { __sync_fetch_and_sub(&pending, 1); }
+
+  // runs tasks until all the ones spawned in this group are done
+  void wait() { waitForTasks(pending); }
+};
+
+// A count that each worker adds to in its own cache line, e.g. nodes touched during a
+// traversal. take() adds them up and resets them, once the tasks are done.
+class TaskCounter
+{
+  unsigned long long counts[MAX_TASK_THREADS][8];
+
+public:
+  TaskCounter() { for (int w = 0; w < MAX_TASK_THREADS; w++) counts[w][0] = 0; }
+
+  void inc() { counts[taskWorker][0]++; }
+
+  unsigned long long take()
+  {
+    unsigned long long sum = 0;
+    for (int w = 0; w < taskThreads; w++)
+    {
+      sum += counts[w][0];
+      counts[w][0] = 0;
+    }
+    return sum;
+  }
+};
+
+#endif
+
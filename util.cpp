@@ -198,8 +198,98 @@ void seedCurMicroSec()
   #endif
 }
 
+void seedRand(unsigned long long seed)
+{
+  #if defined(_WIN32) || defined(_WIN64)
+  srand(static_cast<unsigned int>(seed));
+  #else
+  srand48(static_cast<long>(seed));
+  #endif
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+// the stream of a thread that has its own (see seedThreadRand)
+static __thread bool threadRand = false;
+static __thread unsigned short threadRandState[3];
+#endif
+
+// the counter-based stream this thread is drawing from (see setRandStream)
+static __thread bool counterRand = false;
+static __thread unsigned long long randKey = 0;
+static __thread unsigned long long randCounter = 0;
+
+// the SplitMix64 finalizer: every bit of x affects every bit of the result
+static inline unsigned long long mix64(unsigned long long x)
+{
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// The n-th number of a stream is a hash of its key and n, so each (iteration, player, thread)
+// gets a stream of its own that does not depend on what was drawn before, or on which 
+// thread draws from it
+void setRandStream(unsigned long long seed, unsigned long long iteration, int player, int thread)
+{
+  counterRand = true;
+  randKey = mix64(mix64(mix64(seed + 0x9E3779B97F4A7C15ULL) ^ iteration) 
+                  ^ ((static_cast<unsigned long long>(thread) << 8) | static_cast<unsigned long long>(player)));
+  randCounter = 0;
+}
+
+void endRandStream()
+{
+  counterRand = false;
+}
+
+void seedThreadRand(unsigned long long seed)
+{
+  #if !defined(_WIN32) && !defined(_WIN64)
+  threadRand = true;
+  threadRandState[0] = 0x330E;  // as srand48 does with the low bits
+  threadRandState[1] = static_cast<unsigned short>(seed);
+  threadRandState[2] = static_cast<unsigned short>(seed >> 16);
+  #else
+  srand(static_cast<unsigned int>(seed));
+  #endif
+}
+
+void saveThreadRand(ThreadRandState & saved)
+{
+  #if !defined(_WIN32) && !defined(_WIN64)
+  saved.own = threadRand;
+  memcpy(saved.state, threadRandState, sizeof(threadRandState));
+  #else
+  saved.own = false;
+  #endif
+}
+
+void restoreThreadRand(const ThreadRandState & saved)
+{
+  #if !defined(_WIN32) && !defined(_WIN64)
+  threadRand = saved.own;
+  memcpy(threadRandState, saved.state, sizeof(threadRandState));
+  #else
+  (void) saved;
+  #endif
+}
+
 double unifRand01()
 {
+  if (counterRand)
+  {
+    randCounter++;
+
+    // the top 53 bits, in [0,1)
+    return static_cast<double>(mix64(randKey + randCounter*0x9E3779B97F4A7C15ULL) >> 11) 
+           * (1.0 / 9007199254740992.0);
+  }
+
+  #if !defined(_WIN32) && !defined(_WIN64)
+  if (threadRand)
+    return erand48(threadRandState);
+  #endif
+
   #if defined(_WIN32) || defined(_WIN64)
   // adding the 1 here just seems outright wrong, but if I don't add it then this sometimes returns 1
   // and the code breaks. I spent some time searching for a better answer and could not one without 